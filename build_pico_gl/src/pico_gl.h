@@ -12,11 +12,19 @@
     - Single header library for easy build system integration
     - Embeds GLAD for seamless OpenGL function loading
     - Simple texture and shader creation
+    - Optional shader program binary cache
     - Default shader and uniforms
     - Rendering of dynamic vertex arrays and static vertex buffers
+    - Merging of static buffers and multi-draw submission
     - Render to texture
+    - Runtime texture atlas packing
+    - Multiple texture units
+    - Asynchronous texture uploads and pixel readback
     - Simplified shader uniform setters
+    - Redundant uniform uploads are skipped
+    - Uniform buffers shared between shaders
     - State stack
+    - Frame statistics
     - Simple and concise API
     - Permissive license (zlib or public domain)
 
@@ -35,6 +43,11 @@
     and textures will be used. It is likely to be sufficient unless performing
     advanced VFX.
 
+    Shader creation can dominate startup time when there are many shaders. If
+    a cache directory is specified using `pgl_set_shader_cache`, linked
+    programs are saved to it and loaded on subsequent runs instead of being
+    compiled.
+
     The default shader exposes two uniform variables: 1) a projection matrix;
     and 2) an affine transformation matrix. These two matrices are multipled
     together to form the mapping from vertices to the screen.
@@ -43,9 +56,59 @@
     the viewport parameters are managed using the state stack. This enables
     state changes to be isolated. Push the current state on the top of the
     stack, make some local changes, and pop the stack to restore the original
-    state.
-
-    Uniforms can be set using a simple, fast, and concise API.
+    state. Pushing is cheap, since a field is only saved when it is first
+    modified after the push. Only the state that changed since the previous
+    draw call is applied.
+
+    Each render target has its own state stack, so switching between targets
+    (e.g. when ping-ponging a blur) does not reset the state. Multi-sampled
+    targets are only resolved when they are sampled.
+
+    Bitmaps can be packed into a texture atlas at runtime. Each bitmap is
+    assigned a region of a large texture (a page) together with the texture
+    coordinates of the region. Drawing from regions of the same page does not
+    require switching textures.
+
+    The texture passed to the drawing functions is bound to texture unit 0.
+    Additional textures (e.g. normal maps or palettes) can be bound to other
+    units using `pgl_bind_texture_unit`. They remain bound across draw calls,
+    so the corresponding sampler uniforms only need to be set once using
+    `pgl_set_s2d`.
+
+    Static geometry stored in many buffers can be merged into a single buffer
+    using `pgl_merge_buffers`, which returns the range of vertices occupied by
+    each of the original buffers. Any number of ranges can then be drawn with
+    a single call to `pgl_draw_buffer_ranges`.
+
+    The work done by a context (draw calls, uploads, binds, uniform and state
+    changes) is counted. The counters can be read using `pgl_get_stats`, and
+    are typically reset at the start of each frame using `pgl_reset_stats`.
+
+    Unless NDEBUG is defined, OpenGL errors are logged. Each context created on
+    a debug OpenGL context (`GL_CONTEXT_FLAG_DEBUG_BIT`) with `GL_KHR_debug`
+    installs a synchronous debug message callback, which attributes errors to
+    the OpenGL call made by the library that caused them. This keeps error
+    checking cheap, since it avoids calling `glGetError` after every call,
+    which stalls the driver. `glGetError` is still checked after every call
+    while any context lacks the callback.
+
+    Bitmaps passed to the texture and atlas functions are tightly packed: each
+    row is exactly the width times the size of a pixel, with no padding.
+
+    Textures that change every frame can be updated with
+    `pgl_update_texture_async`, which streams the data through pixel buffer
+    objects instead of blocking on the transfer. Similarly, pixels can be read
+    back without stalling using `pgl_read_pixels_async`, with the result
+    collected later (typically on the next frame) with `pgl_poll_readback`.
+
+    Uniforms can be set using a simple, fast, and concise API. Each shader keeps
+    a shadow copy of its uniform values, so setting a uniform to the value it
+    already holds does not result in an OpenGL call.
+
+    Data that is common to many shaders (e.g. per-frame globals) can be placed
+    in a uniform buffer. The buffer is bound to a binding point and each shader
+    associates its named uniform block with the same binding point. The data is
+    then uploaded once and shared by every shader.
 
     Please see the examples for more details.
 
@@ -62,6 +125,8 @@
     - PICO_GL_UNIFORM_NAME_LENGTH (default: 32)
     - PICO_GL_MAX_UNIFORMS (default: 32)
     - PICO_GL_MAX_STATES (default: 32)
+    - PICO_GL_MAX_ATLAS_PAGES (default: 8)
+    - PICO_GL_MAX_TEXTURE_UNITS (default: 8)
 
     Must be defined before PICO_GL_IMPLEMENTATION
 
@@ -72,7 +137,6 @@
     - Shader examples
     - Scissor
     - Indexed buffers
-    - Multiple texture units
 */
 #ifndef PICO_GL_H
 #define PICO_GL_H
@@ -111,6 +175,7 @@ typedef enum
     PGL_INVALID_ATTRIBUTE_COUNT,       //!< Invalid number of attributes
     PGL_INVALID_UNIFORM_COUNT,         //!< Invalid number of uniforms
     PGL_INVALID_UNIFORM_NAME,          //!< Invalid uniform name
+    PGL_ATLAS_FULL,                    //!< No space left in texture atlas
     PGL_UNKNOWN_ERROR,                 //!< Unknown error
     PGL_ERROR_COUNT
 } pgl_error_t;
@@ -272,6 +337,60 @@ typedef struct pgl_texture_t pgl_texture_t;
  */
 typedef struct pgl_buffer_t pgl_buffer_t;
 
+/**
+ * @brief Contains uniform buffer data/state
+ */
+typedef struct pgl_uniform_buffer_t pgl_uniform_buffer_t;
+
+/**
+ * @brief Contains texture atlas data/state
+ */
+typedef struct pgl_atlas_t pgl_atlas_t;
+
+/**
+ * @brief Contains asynchronous pixel readback data/state
+ */
+typedef struct pgl_readback_t pgl_readback_t;
+
+/**
+ * @brief A rectangular region of a texture
+ */
+typedef struct
+{
+    pgl_texture_t* texture; //!< The texture containing the region
+    int32_t x, y, w, h;     //!< Position and size of the region in pixels
+    float u0, v0;           //!< Texture coordinates of the first corner
+    float u1, v1;           //!< Texture coordinates of the opposite corner
+} pgl_region_t;
+
+/**
+ * @brief Counters of the work done by a context
+ *
+ * The counters accumulate until they are reset using `pgl_reset_stats`.
+ */
+typedef struct
+{
+    pgl_size_t draw_calls;     //!< Number of OpenGL draw calls
+    uint64_t   vertices;       //!< Number of vertices (or indices) drawn
+    uint64_t   bytes_uploaded; //!< Bytes of vertex, index, pixel and uniform data uploaded
+    pgl_size_t texture_binds;  //!< Number of texture binding changes
+    pgl_size_t shader_binds;   //!< Number of shader binding changes
+    pgl_size_t uniform_sets;   //!< Number of uniform values uploaded
+    pgl_size_t uniform_skips;  //!< Number of redundant uniform values skipped
+    pgl_size_t state_applies;  //!< Number of state groups applied before draws
+    pgl_size_t state_skips;    //!< Number of unchanged state groups skipped
+    pgl_size_t error_checks;   //!< Number of OpenGL error checks (always 0 if NDEBUG is defined)
+} pgl_stats_t;
+
+/**
+ * @brief A range of vertices in a buffer
+ */
+typedef struct
+{
+    pgl_size_t start; //!< The index of the first vertex
+    pgl_size_t count; //!< The number of vertices
+} pgl_range_t;
+
 /**
  * @brief Defines an OpenGL (GLAD) function loader
  *
@@ -379,6 +498,26 @@ pgl_shader_t* pgl_create_shader(pgl_ctx_t* ctx, const char* vert_src,
  */
 void pgl_destroy_shader(pgl_shader_t* shader);
 
+/**
+ * @brief Enables the shader program binary cache
+ *
+ * Once enabled, `pgl_create_shader` saves linked programs to the specified
+ * directory, and loads them from it when a shader with the same sources is
+ * created again. Cached programs are keyed by a hash of the sources and the
+ * OpenGL renderer and version, so they are invalidated by driver updates. If
+ * a cached program can't be loaded, the shader is compiled from source.
+ *
+ * Requires OpenGL 4.1, `GL_ARB_get_program_binary`, or OpenGL ES 3.0.
+ *
+ * @param ctx  The relevant context
+ * @param path An existing directory to store the programs in, or `NULL` to
+ *             disable the cache
+ *
+ * @returns 0 on success and -1 on failure (e.g. if program binaries are not
+ * supported)
+ */
+int pgl_set_shader_cache(pgl_ctx_t* ctx, const char* path);
+
 /**
  * @brief Activates a shader program for rendering
  *
@@ -464,6 +603,28 @@ void pgl_update_texture(pgl_ctx_t* ctx,
                         int w, int h,
                         const uint8_t* bitmap);
 
+/**
+ * @brief Asynchronously updates a region of an existing texture
+ *
+ * The pixel data is copied into one of two alternating pixel buffer objects
+ * (PBOs) and transferred to the texture by the driver, without stalling the
+ * caller until the transfer completes. This is useful for streaming data,
+ * such as video frames, into a texture every frame.
+ *
+ * @param ctx     The relevant context
+ * @param texture The texture to update
+ * @param x       The x offset of the region
+ * @param y       The y offset of the region
+ * @param w       The width of the region
+ * @param h       The height of the region
+ * @param bitmap  The pixel data in the format of the texture (tightly packed)
+ */
+void pgl_update_texture_async(pgl_ctx_t* ctx,
+                              pgl_texture_t* texture,
+                              int x, int y,
+                              int w, int h,
+                              const uint8_t* bitmap);
+
 /**
  * @brief Generate mipmaps for the specified texture
  *
@@ -511,6 +672,19 @@ void pgl_get_max_texture_size(int* w, int* h);
  */
 uint64_t pgl_get_texture_id(const pgl_texture_t* texture);
 
+/**
+ * @brief Resolves a multi-sampled render target into its texture
+ *
+ * Render targets of multi-sampled contexts are resolved lazily, when they are
+ * bound for sampling. This function only needs to be called if the texture is
+ * going to be accessed outside of pico_gl (e.g. using `pgl_get_texture_id`).
+ * It does nothing if the target has not been rendered to since it was last
+ * resolved.
+ *
+ * @param target The render target to resolve
+ */
+void pgl_resolve_target(pgl_texture_t* target);
+
 /**
  * @brief Activates a texture for rendering
  *
@@ -522,12 +696,89 @@ uint64_t pgl_get_texture_id(const pgl_texture_t* texture);
  */
 void pgl_bind_texture(pgl_ctx_t* ctx, pgl_texture_t* texture);
 
+/**
+ * @brief Activates a texture on the specified texture unit
+ *
+ * Unit 0 is used by the drawing functions. Textures bound to the other units
+ * remain bound until they are replaced, which allows a shader to sample
+ * several textures in a single draw call. The shader's samplers are associated
+ * with units using `pgl_set_s2d`.
+ *
+ * @param ctx     The relevant context
+ * @param texture The texture to activate, or `NULL` to deactivate
+ * @param unit    The texture unit (less than `PICO_GL_MAX_TEXTURE_UNITS`)
+ */
+void pgl_bind_texture_unit(pgl_ctx_t* ctx, pgl_texture_t* texture, pgl_size_t unit);
+
+/**
+ * @brief Creates a texture atlas
+ *
+ * A texture atlas packs many small bitmaps into a few large textures (pages).
+ * Draws that use regions of the same page can share a texture, and therefore
+ * be batched. New pages are created as required, up to
+ * `PICO_GL_MAX_ATLAS_PAGES`.
+ *
+ * @param ctx     The relevant context
+ * @param fmt     The pixel format of the pages
+ * @param srgb    True if the internal format is sRGB
+ * @param w       The width of each page
+ * @param h       The height of each page
+ * @param padding Empty space (in pixels) between adjacent regions
+ * @param smooth  High (true) or low (false) quality filtering
+ *
+ * @returns A pointer to the atlas or `NULL` on error
+ */
+pgl_atlas_t* pgl_create_atlas(pgl_ctx_t* ctx,
+                              pgl_format_t fmt, bool srgb,
+                              int32_t w, int32_t h,
+                              int32_t padding, bool smooth);
+
+/**
+ * @brief Destroys a texture atlas and all of its pages
+ *
+ * @param atlas The atlas to destroy
+ */
+void pgl_destroy_atlas(pgl_atlas_t* atlas);
+
+/**
+ * @brief Packs a bitmap into the atlas
+ *
+ * @param atlas  The target atlas
+ * @param w      The width of the bitmap
+ * @param h      The height of the bitmap
+ * @param bitmap The pixel data in the format of the atlas (tightly packed)
+ * @param region The region the bitmap was packed into (output)
+ *
+ * @returns 0 on success and -1 on failure
+ */
+int pgl_add_to_atlas(pgl_atlas_t* atlas,
+                     int32_t w, int32_t h,
+                     const uint8_t* bitmap,
+                     pgl_region_t* region);
+
+/**
+ * @brief Returns the number of pages in the atlas
+ */
+pgl_size_t pgl_get_atlas_page_count(const pgl_atlas_t* atlas);
+
+/**
+ * @brief Returns the texture of the specified atlas page
+ *
+ * @param atlas The atlas
+ * @param index The index of the page
+ */
+pgl_texture_t* pgl_get_atlas_page(const pgl_atlas_t* atlas, pgl_size_t index);
+
 /**
  * @brief Draw to texture
  *
  * The function set a texture to be the target for rendering until the texture
  * if replaced by another or set to `NULL`.
  *
+ * Each render target has its own state and state stack, which are kept across
+ * switches. A target starts with the default state and a viewport covering the
+ * texture. The state of the default framebuffer is kept in the same way.
+ *
  * @param ctx     The relevant context
  * @param texture The render target
  *
@@ -542,6 +793,55 @@ int pgl_set_render_target(pgl_ctx_t* ctx, pgl_texture_t* texture);
  */
 void pgl_clear(float r, float g, float b, float a);
 
+/**
+ * @brief Creates an object used to read pixels asynchronously
+ *
+ * @param ctx The relevant context
+ *
+ * @returns A pointer to the readback object or `NULL` on error
+ */
+pgl_readback_t* pgl_create_readback(pgl_ctx_t* ctx);
+
+/**
+ * @brief Destroys a readback object
+ *
+ * @param readback The readback object to destroy
+ */
+void pgl_destroy_readback(pgl_readback_t* readback);
+
+/**
+ * @brief Starts an asynchronous read of a region of the current render target
+ *
+ * The pixels are copied into a pixel buffer object (PBO) by the GPU. Use
+ * `pgl_poll_readback` to retrieve them once the copy has completed (typically
+ * a frame later). Any previous request on the same object is discarded.
+ *
+ * @param ctx      The relevant context
+ * @param readback The readback object
+ * @param x        The left edge of the region
+ * @param y        The bottom edge of the region
+ * @param w        The width of the region
+ * @param h        The height of the region
+ *
+ * @returns 0 on success and -1 on failure
+ */
+int pgl_read_pixels_async(pgl_ctx_t* ctx,
+                          pgl_readback_t* readback,
+                          int32_t x, int32_t y,
+                          int32_t w, int32_t h);
+
+/**
+ * @brief Retrieves the pixels of a completed asynchronous read
+ *
+ * @param readback The readback object
+ * @param pixels   Destination for the pixels in RGBA format (`w * h * 4` bytes)
+ * @param wait     If true, blocks until the read has completed
+ *
+ * @returns True if the pixels were copied, and false if the read has not
+ * completed yet (or no read is pending)
+ */
+bool pgl_poll_readback(pgl_readback_t* readback, uint8_t* pixels, bool wait);
+
 /**
  * Draws primitives according to a vertex array
  *
@@ -629,6 +929,66 @@ void pgl_draw_buffer(pgl_ctx_t* ctx,
                      pgl_texture_t* texture,
                      pgl_shader_t* shader);
 
+/**
+ * @brief Merges several buffers into a single new buffer
+ *
+ * The vertices are copied on the GPU, in order. The source buffers are left
+ * unchanged, and may be destroyed once they are merged. All of the buffers
+ * must have the same primitive type.
+ *
+ * @param ctx     The relevant context
+ * @param buffers An array of buffers to merge
+ * @param count   The number of buffers
+ * @param ranges  Receives the range occupied by each buffer in the new buffer
+ *                (can be `NULL`)
+ *
+ * @returns A pointer to the merged buffer or `NULL` on error
+ */
+pgl_buffer_t* pgl_merge_buffers(pgl_ctx_t* ctx,
+                                pgl_buffer_t* const* buffers,
+                                pgl_size_t count,
+                                pgl_range_t* ranges);
+
+/**
+ * @brief Draws several ranges of a buffer in a single call
+ *
+ * Uses `glMultiDrawArrays` where available (i.e. on desktop OpenGL), so that
+ * the ranges are submitted together. Otherwise the ranges are drawn one after
+ * the other.
+ *
+ * @param ctx         The relevant context
+ * @param buffer      The buffer to draw
+ * @param ranges      The ranges of vertices to draw
+ * @param range_count The number of ranges
+ * @param texture     The texture to draw from (can be `NULL`)
+ * @param shader      The shader used to draw the ranges (cannot be `NULL`)
+ */
+void pgl_draw_buffer_ranges(pgl_ctx_t* ctx,
+                            const pgl_buffer_t* buffer,
+                            const pgl_range_t* ranges,
+                            pgl_size_t range_count,
+                            pgl_texture_t* texture,
+                            pgl_shader_t* shader);
+
+/**
+ * @brief Returns the counters of the work done by a context
+ *
+ * Error checks are counted across all contexts, since they are not
+ * associated with a particular context.
+ *
+ * @param ctx   The relevant context
+ * @param stats Receives the counters accumulated since the last reset
+ */
+void pgl_get_stats(const pgl_ctx_t* ctx, pgl_stats_t* stats);
+
+/**
+ * @brief Resets the counters of a context to zero (e.g. at the start of a
+ * frame)
+ *
+ * @param ctx The relevant context
+ */
+void pgl_reset_stats(pgl_ctx_t* ctx);
+
 /**
  * @brief Turns matrix transposition on/off
  */
@@ -991,6 +1351,67 @@ void pgl_set_m4(pgl_shader_t* shader, const char* name, const pgl_m4_t matrix);
  */
 void pgl_set_s2d(pgl_shader_t* shader, const char* name, int32_t value);
 
+/**
+ * @brief Creates a uniform buffer object (UBO)
+ *
+ * Uniform buffers store blocks of uniforms in VRAM that can be shared by
+ * multiple shaders. This is useful for data that is common to many shaders
+ * (e.g. per-frame globals), since it only needs to be uploaded once.
+ *
+ * @param ctx  The relevant context
+ * @param size The size of the buffer in bytes
+ * @param data The initial contents of the buffer (can be `NULL`)
+ *
+ * @returns A pointer to the uniform buffer or `NULL` on error
+ */
+pgl_uniform_buffer_t* pgl_create_uniform_buffer(pgl_ctx_t* ctx,
+                                                pgl_size_t size,
+                                                const void* data);
+
+/**
+ * @brief Destroys a uniform buffer
+ *
+ * @param buffer The uniform buffer to destroy
+ */
+void pgl_destroy_uniform_buffer(pgl_uniform_buffer_t* buffer);
+
+/**
+ * @brief Updates a region of a uniform buffer
+ *
+ * @param buffer The uniform buffer to update
+ * @param offset The offset (in bytes) of the region
+ * @param size   The size (in bytes) of the region
+ * @param data   The new contents of the region
+ */
+void pgl_update_uniform_buffer(pgl_uniform_buffer_t* buffer,
+                               pgl_size_t offset,
+                               pgl_size_t size,
+                               const void* data);
+
+/**
+ * @brief Binds a uniform buffer to a uniform block binding point
+ *
+ * Shaders access the buffer through named uniform blocks that have been
+ * associated with the same binding point (@see pgl_set_uniform_block).
+ *
+ * @param buffer  The uniform buffer to bind
+ * @param binding The binding point
+ */
+void pgl_bind_uniform_buffer(pgl_uniform_buffer_t* buffer, pgl_size_t binding);
+
+/**
+ * @brief Associates a named uniform block with a binding point
+ *
+ * This only needs to be done once per shader.
+ *
+ * @param shader  The shader program containing the block
+ * @param name    The name of the uniform block
+ * @param binding The binding point
+ *
+ * @returns 0 on success and -1 if the block does not exist
+ */
+int pgl_set_uniform_block(pgl_shader_t* shader, const char* name, pgl_size_t binding);
+
 #endif // PICO_GL_H
 
 #ifdef __cplusplus
@@ -1035,6 +1456,14 @@ void pgl_set_s2d(pgl_shader_t* shader, const char* name, int32_t value);
 #define PICO_GL_MAX_STATES 32
 #endif
 
+#ifndef PICO_GL_MAX_ATLAS_PAGES
+#define PICO_GL_MAX_ATLAS_PAGES 8
+#endif
+
+#ifndef PICO_GL_MAX_TEXTURE_UNITS
+#define PICO_GL_MAX_TEXTURE_UNITS 8
+#endif
+
 /*=============================================================================
  * Internal aliases
  *============================================================================*/
@@ -1046,6 +1475,8 @@ void pgl_set_s2d(pgl_shader_t* shader, const char* name, int32_t value);
 #define PGL_UNIFORM_NAME_LENGTH PICO_GL_UNIFORM_NAME_LENGTH
 #define PGL_MAX_UNIFORMS        PICO_GL_MAX_UNIFORMS
 #define PGL_MAX_STATES          PICO_GL_MAX_STATES
+#define PGL_MAX_ATLAS_PAGES     PICO_GL_MAX_ATLAS_PAGES
+#define PGL_MAX_TEXTURE_UNITS   PICO_GL_MAX_TEXTURE_UNITS
 
 /*=============================================================================
  * Internal PGL enum to GL enum maps
@@ -1055,12 +1486,33 @@ void pgl_set_s2d(pgl_shader_t* shader, const char* name, int32_t value);
     #define PGL_CHECK(expr) (expr)
 #else
     #define PGL_CHECK(expr) do { \
+        pgl_leave_breadcrumb(__FILE__, __LINE__, #expr); \
         expr; pgl_log_error(__FILE__, __LINE__, #expr); \
     }  while(false)
 #endif
 
 static bool pgl_initialized = false;
 
+// Number of error checks (see `PGL_CHECK`), reported in the statistics of
+// each context
+static uint64_t pgl_check_count = 0;
+
+// Number of live contexts, and how many of them report errors through the
+// GL_KHR_debug message callback. glGetError is only skipped if all of them do
+static int pgl_context_count = 0;
+static int pgl_debug_context_count = 0;
+
+#ifndef NDEBUG
+// Identifies the most recent checked OpenGL call, so that errors reported by
+// the debug message callback can be attributed to it
+static struct
+{
+    const char* file;
+    unsigned    line;
+    const char* expr;
+} pgl_breadcrumb = { "", 0, "" };
+#endif
+
 static const char* pgl_error_msg_map[] =
 {
     "No error",
@@ -1077,6 +1529,7 @@ static const char* pgl_error_msg_map[] =
     "Invalid number of attributes",
     "Invalid number of uniforms",
     "Invalid uniform name",
+    "No space left in texture atlas",
     "Unknown error",
     0
 };
@@ -1090,6 +1543,15 @@ static const GLenum pgl_format_map[] =
     GL_BGRA
 };
 
+static const pgl_size_t pgl_format_size_map[] =
+{
+    1,
+    3,
+    4,
+    3,
+    4
+};
+
 static const GLenum pgl_blend_factor_map[] =
 {
     GL_ZERO,
@@ -1143,6 +1605,9 @@ typedef struct
 	GLenum     type;
 	GLint      location;
 	pgl_hash_t hash;
+	bool       cached;
+	bool       transpose;
+	uint8_t    cache[sizeof(pgl_m4_t)];
 } pgl_uniform_t;
 
 typedef struct
@@ -1159,13 +1624,44 @@ typedef struct
     float            line_width;
 } pgl_state_t;
 
+// State groups used to track which fields have been modified
+enum
+{
+    PGL_STATE_BLEND      = 1 << 0,
+    PGL_STATE_TRANSFORM  = 1 << 1,
+    PGL_STATE_PROJECTION = 1 << 2,
+    PGL_STATE_VIEWPORT   = 1 << 3,
+    PGL_STATE_LINE_WIDTH = 1 << 4,
+    PGL_STATE_ALL        = (1 << 5) - 1
+};
+
+// A frame only holds the fields that were modified after the push
+typedef struct
+{
+    uint32_t    saved;
+    pgl_state_t state;
+} pgl_state_frame_t;
+
 typedef struct
 {
     pgl_size_t size;
     pgl_state_t state;
-    pgl_state_t array[PGL_MAX_STATES];
+    pgl_state_frame_t array[PGL_MAX_STATES];
 } pgl_state_stack_t;
 
+// A horizontal segment of the skyline used to pack atlas pages
+typedef struct
+{
+    int32_t x, y, w;
+} pgl_skyline_node_t;
+
+typedef struct
+{
+    pgl_texture_t*      texture;
+    pgl_size_t          node_count;
+    pgl_skyline_node_t* nodes;
+} pgl_atlas_page_t;
+
 /*=============================================================================
  * Internal function declarations
  *============================================================================*/
@@ -1177,24 +1673,57 @@ static const char* pgl_get_default_frag_shader();
 
 static pgl_state_stack_t* pgl_get_active_stack(pgl_ctx_t* ctx);
 static pgl_state_t* pgl_get_active_state(pgl_ctx_t* ctx);
+static pgl_state_t* pgl_modify_state(pgl_ctx_t* ctx, uint32_t fields);
+static void pgl_copy_state(pgl_state_t* dst, const pgl_state_t* src, uint32_t fields);
 
-static void pgl_reset_last_state(pgl_ctx_t* ctx);
-
-static void pgl_apply_blend(pgl_ctx_t* ctx, const pgl_blend_mode_t* mode);
+static void pgl_apply_blend(const pgl_blend_mode_t* mode);
 static void pgl_apply_transform(pgl_ctx_t* ctx, const pgl_m4_t matrix);
 static void pgl_apply_projection(pgl_ctx_t* ctx, const pgl_m4_t matrix);
-static void pgl_apply_viewport(pgl_ctx_t* ctx, const pgl_viewport_t* viewport);
+static void pgl_apply_viewport(const pgl_viewport_t* viewport);
 
 static void pgl_before_draw(pgl_ctx_t* ctx, pgl_texture_t* texture, pgl_shader_t* shader);
-static void pgl_after_draw(pgl_ctx_t* ctx);
+
+static GLuint pgl_compile_program(pgl_ctx_t* ctx, const char* vert_src,
+                                                  const char* frag_src);
+
+static uint64_t pgl_hash_program(const char* vert_src, const char* frag_src);
+static const char* pgl_get_cache_path(pgl_ctx_t* ctx, uint64_t key);
+static GLuint pgl_load_program_binary(pgl_ctx_t* ctx, uint64_t key);
+static void pgl_save_program_binary(pgl_ctx_t* ctx, GLuint program, uint64_t key);
 
 static int pgl_load_uniforms(pgl_shader_t* shader);
-static const pgl_uniform_t* pgl_find_uniform(const pgl_shader_t* shader, const char* name);
+static pgl_uniform_t* pgl_find_uniform(pgl_shader_t* shader, const char* name);
+
+static bool pgl_shadow_uniform(const pgl_shader_t* shader, pgl_uniform_t* uniform,
+                               const void* data, size_t size);
+static bool pgl_shadow_matrix(const pgl_shader_t* shader, pgl_uniform_t* uniform,
+                              const void* data, size_t size);
 
 static void pgl_bind_attributes();
 
+static void pgl_resolve_msaa(pgl_texture_t* target);
+
+static void pgl_bind_target_framebuffer(pgl_ctx_t* ctx);
+
+static int pgl_add_atlas_page(pgl_atlas_t* atlas);
+static bool pgl_pack_atlas_page(pgl_atlas_page_t* page, int32_t page_w, int32_t page_h,
+                                int32_t w, int32_t h, int32_t* x, int32_t* y);
+static int32_t pgl_skyline_fit(const pgl_atlas_page_t* page, pgl_size_t index,
+                               int32_t page_w, int32_t page_h, int32_t w, int32_t h);
+static void pgl_skyline_insert(pgl_atlas_page_t* page, pgl_size_t index,
+                               int32_t x, int32_t y, int32_t w, int32_t h);
+
 static void pgl_log(const char* fmt, ...);
 static void pgl_log_error(const char* file, unsigned line, const char* expr);
+
+#ifndef NDEBUG
+static void pgl_leave_breadcrumb(const char* file, unsigned line, const char* expr);
+static bool pgl_enable_debug_output(pgl_ctx_t* ctx);
+static void APIENTRY pgl_debug_callback(GLenum source, GLenum type, GLuint id,
+                                        GLenum severity, GLsizei length,
+                                        const GLchar* message,
+                                        const void* user_param);
+#endif
 static pgl_error_t pgl_map_error(GLenum id);
 static pgl_hash_t pgl_hash_str(const char* str);
 static bool pgl_str_equal(const char* str1, const char* str2);
@@ -1211,6 +1740,15 @@ static bool pgl_mem_equal(const void* ptr1, const void* ptr2, size_t size);
 static const pgl_hash_t PGL_OFFSET_BASIS = 0x811C9DC5;
 static const pgl_hash_t PGL_PRIME = 0x1000193;
 
+// Program binary cache files start with "PGLB"
+static const uint32_t PGL_CACHE_MAGIC = 0x424C4750;
+
+// Length of a cache file name (16 hex digits, extension and terminator)
+#define PGL_CACHE_NAME_LENGTH 21
+
+// Maximum number of ranges submitted by a single glMultiDrawArrays call
+#define PGL_MULTI_DRAW_BATCH_SIZE 256
+
 /*=============================================================================
  * Shaders GL3
  *============================================================================*/
@@ -1273,19 +1811,26 @@ struct pgl_ctx_t
 {
     pgl_error_t       error_code;
     pgl_shader_t*     shader;
-    pgl_texture_t*    texture;
+    pgl_texture_t*    textures[PGL_MAX_TEXTURE_UNITS];
     pgl_texture_t*    target;
-    pgl_state_t       last_state;
+    pgl_shader_t*     draw_shader;
+    uint32_t          dirty;
     pgl_state_stack_t stack;
-    pgl_state_stack_t target_stack;
     GLuint            vao;
     GLuint            vbo;
     GLuint            ebo;
+    GLuint            upload_pbos[2];
+    pgl_size_t        upload_index;
     uint32_t          w, h;
     uint32_t          samples;
     bool              srgb;
     bool              depth;
     bool              transpose;
+    bool              debug_output;
+    char*             cache_path;
+    size_t            cache_dir_length;
+    pgl_stats_t       stats;
+    uint64_t          check_base;
     void*             mem_ctx;
 };
 
@@ -1318,16 +1863,46 @@ struct pgl_texture_t
     GLuint       rbo_msaa;
     GLuint       depth_id;
     GLuint       depth_rbo_msaa;
+    bool         unresolved;
+    pgl_state_stack_t* stack;
 };
 
 struct pgl_buffer_t
 {
+    pgl_ctx_t* ctx;
     GLenum  primitive;
     GLuint  vao;
     GLuint  vbo;
     GLsizei count;
 };
 
+struct pgl_atlas_t
+{
+    pgl_ctx_t*       ctx;
+    pgl_format_t     fmt;
+    bool             srgb;
+    bool             smooth;
+    int32_t          w, h;
+    int32_t          padding;
+    pgl_size_t       page_count;
+    pgl_atlas_page_t pages[PGL_MAX_ATLAS_PAGES];
+};
+
+struct pgl_readback_t
+{
+    pgl_ctx_t* ctx;
+    GLuint     pbo;
+    GLsync     fence;
+    pgl_size_t size;
+};
+
+struct pgl_uniform_buffer_t
+{
+    pgl_ctx_t* ctx;
+    GLuint     id;
+    pgl_size_t size;
+};
+
 pgl_error_t pgl_get_error(pgl_ctx_t* ctx)
 {
     return ctx->error_code;
@@ -1452,6 +2027,16 @@ pgl_ctx_t* pgl_create_context(uint32_t w, uint32_t h, bool depth,
     ctx->depth = depth;
     ctx->mem_ctx = mem_ctx;
 
+    // Checks use glGetError until the debug callback is installed
+    pgl_context_count++;
+
+#ifndef NDEBUG
+    ctx->debug_output = pgl_enable_debug_output(ctx);
+
+    if (ctx->debug_output)
+        pgl_debug_context_count++;
+#endif
+
     // Create VBO/EBO
     PGL_CHECK(glGenVertexArrays(1, &ctx->vao));
     PGL_CHECK(glBindVertexArray(ctx->vao));
@@ -1464,6 +2049,12 @@ pgl_ctx_t* pgl_create_context(uint32_t w, uint32_t h, bool depth,
     pgl_bind_attributes();
     PGL_CHECK(glBindVertexArray(0));
 
+    // Create PBOs for asynchronous texture uploads
+    PGL_CHECK(glGenBuffers(2, ctx->upload_pbos));
+
+    // Bitmaps are tightly packed, rows are not padded to four bytes
+    PGL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
     if (samples > 0)
     {
         GLint max_samples = 0;
@@ -1477,6 +2068,7 @@ pgl_ctx_t* pgl_create_context(uint32_t w, uint32_t h, bool depth,
 
     pgl_clear_stack(ctx);
     pgl_reset_state(ctx);
+    pgl_reset_stats(ctx);
 
     return ctx;
 }
@@ -1487,7 +2079,17 @@ void pgl_destroy_context(pgl_ctx_t* ctx)
 
     PGL_CHECK(glDeleteBuffers(1, &ctx->vbo));
     PGL_CHECK(glDeleteBuffers(1, &ctx->ebo));
+    PGL_CHECK(glDeleteBuffers(2, ctx->upload_pbos));
     PGL_CHECK(glDeleteVertexArrays(1, &ctx->vao));
+
+    if (ctx->cache_path)
+        PGL_FREE(ctx->cache_path, ctx->mem_ctx);
+
+    if (ctx->debug_output)
+        pgl_debug_context_count--;
+
+    pgl_context_count--;
+
     PGL_FREE(ctx, ctx->mem_ctx);
 }
 
@@ -1521,99 +2123,106 @@ pgl_shader_t* pgl_create_shader(pgl_ctx_t* ctx, const char* vert_src,
         frag_src = pgl_get_default_frag_shader();
     }
 
-    // Create shaders
-    GLuint vs, fs, program;
+    GLuint program = 0;
+    uint64_t key = 0;
 
-    PGL_CHECK(vs = glCreateShader(GL_VERTEX_SHADER));
-    PGL_CHECK(fs = glCreateShader(GL_FRAGMENT_SHADER));
+    if (ctx->cache_path)
+    {
+        key = pgl_hash_program(vert_src, frag_src);
+        program = pgl_load_program_binary(ctx, key);
+    }
 
-    GLsizei length;
-    GLchar msg[2048];
+    if (!program)
+    {
+        program = pgl_compile_program(ctx, vert_src, frag_src);
 
-    // Compile vertex shader
-    GLint is_compiled = GL_FALSE;
+        if (!program)
+            return NULL;
 
-    PGL_CHECK(glShaderSource(vs, 1, &vert_src, NULL));
-    PGL_CHECK(glCompileShader(vs));
-    PGL_CHECK(glGetShaderiv(vs, GL_COMPILE_STATUS, &is_compiled));
+        if (ctx->cache_path)
+            pgl_save_program_binary(ctx, program, key);
+    }
 
-    if (GL_FALSE == is_compiled)
+    pgl_shader_t* shader = PGL_MALLOC(sizeof(pgl_shader_t), ctx->mem_ctx);
+
+    if (!shader)
     {
-        PGL_CHECK(glGetShaderInfoLog(vs, sizeof(msg), &length, msg));
-        PGL_CHECK(glDeleteShader(vs));
-        PGL_LOG("Error compiling vertex shader: %s", msg);
-        pgl_set_error(ctx, PGL_SHADER_COMPILATION_ERROR);
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
         return NULL;
     }
 
-    // Compile fragment shader
-    is_compiled = GL_FALSE;
+    memset(shader, 0, sizeof(pgl_shader_t));
 
-    PGL_CHECK(glShaderSource(fs, 1, &frag_src, NULL));
-    PGL_CHECK(glCompileShader(fs));
-    PGL_CHECK(glGetShaderiv(fs, GL_COMPILE_STATUS, &is_compiled));
+    shader->program = program;
+    shader->ctx = ctx;
 
-    if (GL_FALSE == is_compiled)
-    {
-        PGL_CHECK(glGetShaderInfoLog(fs, sizeof(msg), &length, msg));
-        PGL_CHECK(glDeleteShader(vs));
-        PGL_CHECK(glDeleteShader(fs));
-        PGL_LOG("Error compiling fragment shader: %s", msg);
-        pgl_set_error(ctx, PGL_SHADER_COMPILATION_ERROR);
-        return NULL;
-    }
+    pgl_bind_shader(ctx, shader);
+    pgl_load_uniforms(shader);
 
-    // Link program
-    GLint is_linked = GL_FALSE;
+    return shader;
+}
 
-    PGL_CHECK(program = glCreateProgram());
+void pgl_destroy_shader(pgl_shader_t* shader)
 
-    PGL_CHECK(glAttachShader(program, vs));
-    PGL_CHECK(glAttachShader(program, fs));
-    PGL_CHECK(glLinkProgram(program));
-    PGL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &is_linked));
+{
+    PGL_ASSERT(shader);
 
-    PGL_CHECK(glDetachShader(program, vs));
-    PGL_CHECK(glDetachShader(program, fs));
-    PGL_CHECK(glDeleteShader(vs));
-    PGL_CHECK(glDeleteShader(fs));
+    pgl_bind_shader(shader->ctx, NULL);
 
-    if (GL_FALSE == is_linked)
+    // A new shader may reuse this address and would miss the matrix upload
+    if (shader->ctx->draw_shader == shader)
+        shader->ctx->draw_shader = NULL;
+
+    PGL_CHECK(glDeleteProgram(shader->program));
+    PGL_FREE(shader, shader->ctx->mem_ctx);
+}
+
+int pgl_set_shader_cache(pgl_ctx_t* ctx, const char* path)
+{
+    PGL_ASSERT(ctx);
+
+    if (ctx->cache_path)
     {
-        PGL_CHECK(glGetProgramInfoLog(program, sizeof(msg), &length, msg));
-        PGL_CHECK(glDeleteProgram(program));
-        PGL_LOG("Error linking shader program: %s", msg);
-        pgl_set_error(ctx, PGL_SHADER_LINKING_ERROR);
-        return NULL;
+        PGL_FREE(ctx->cache_path, ctx->mem_ctx);
+        ctx->cache_path = NULL;
     }
 
-    pgl_shader_t* shader = PGL_MALLOC(sizeof(pgl_shader_t), ctx->mem_ctx);
+    if (!path)
+        return 0;
 
-    if (!shader)
+    GLint format_count = 0;
+
+    if (GLAD_GL_ARB_get_program_binary || GLAD_GL_ES_VERSION_3_0)
+        PGL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count));
+
+    if (format_count <= 0)
     {
-        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
-        return NULL;
+        PGL_LOG("Program binaries are not supported");
+        pgl_set_error(ctx, PGL_INVALID_OPERATION);
+        return -1;
     }
 
-    memset(shader, 0, sizeof(pgl_shader_t));
+    // Allocate enough space to append file names to the directory
+    size_t length = strlen(path);
+    bool separator = length > 0 && ('/' == path[length - 1] || '\\' == path[length - 1]);
 
-    shader->program = program;
-    shader->ctx = ctx;
+    ctx->cache_path = PGL_MALLOC(length + 1 + PGL_CACHE_NAME_LENGTH, ctx->mem_ctx);
 
-    pgl_bind_shader(ctx, shader);
-    pgl_load_uniforms(shader);
+    if (!ctx->cache_path)
+    {
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return -1;
+    }
 
-    return shader;
-}
+    memcpy(ctx->cache_path, path, length);
 
-void pgl_destroy_shader(pgl_shader_t* shader)
+    if (length > 0 && !separator)
+        ctx->cache_path[length++] = '/';
 
-{
-    PGL_ASSERT(shader);
+    ctx->cache_path[length] = '\0';
+    ctx->cache_dir_length = length;
 
-    pgl_bind_shader(shader->ctx, NULL);
-    PGL_CHECK(glDeleteProgram(shader->program));
-    PGL_FREE(shader, shader->ctx->mem_ctx);
+    return 0;
 }
 
 uint64_t pgl_get_shader_id(const pgl_shader_t* shader)
@@ -1630,6 +2239,8 @@ void pgl_bind_shader(pgl_ctx_t* ctx, pgl_shader_t* shader)
     if (ctx->shader == shader)
         return;
 
+    ctx->stats.shader_binds++;
+
     if (NULL != shader)
     {
         PGL_CHECK(glUseProgram(shader->program));
@@ -1703,6 +2314,8 @@ pgl_texture_t* pgl_create_texture(pgl_ctx_t* ctx,
     tex->srgb = srgb;
     tex->target = target;
     tex->smooth = smooth;
+    tex->unresolved = false;
+    tex->stack = NULL;
 
     if (-1 == pgl_upload_texture(ctx, tex, w, h, NULL))
     {
@@ -1729,6 +2342,9 @@ pgl_texture_t* pgl_create_texture(pgl_ctx_t* ctx,
             PGL_CHECK(glBindTexture(GL_TEXTURE_2D, tex->depth_id));
             PGL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0,
                                    GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL));
+
+            // Restore the binding recorded by the context
+            PGL_CHECK(glBindTexture(GL_TEXTURE_2D, tex->id));
         }
 
         // Generate multi-sample buffers for MSAA
@@ -1846,7 +2462,7 @@ pgl_texture_t* pgl_create_texture(pgl_ctx_t* ctx,
 
         // Ensure framebuffer objects are not bound
         PGL_CHECK(glBindRenderbuffer(GL_RENDERBUFFER, 0));
-        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        pgl_bind_target_framebuffer(ctx);
     }
 
     return tex;
@@ -1893,6 +2509,9 @@ int pgl_upload_texture(pgl_ctx_t* ctx,
                                              pgl_format_map[texture->fmt],
                                              GL_UNSIGNED_BYTE, bitmap));
 
+    if (bitmap)
+        ctx->stats.bytes_uploaded += (uint64_t)w * h * pgl_format_size_map[texture->fmt];
+
     return 0;
 }
 
@@ -1912,6 +2531,59 @@ void pgl_update_texture(pgl_ctx_t* ctx,
 
     PGL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, fmt,
                               GL_UNSIGNED_BYTE, bitmap));
+
+    ctx->stats.bytes_uploaded += (uint64_t)w * h * pgl_format_size_map[texture->fmt];
+}
+
+void pgl_update_texture_async(pgl_ctx_t* ctx,
+                              pgl_texture_t* texture,
+                              int x, int y,
+                              int w, int h,
+                              const uint8_t* bitmap)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(texture);
+    PGL_ASSERT(bitmap);
+
+    // Rows are tightly packed since the unpack alignment is 1 (see
+    // pgl_create_context), so odd-width RED/RGB regions need no padding
+    size_t size = (size_t)w * (size_t)h * pgl_format_size_map[texture->fmt];
+
+    // Alternate between PBOs so that the previous transfer can still be in
+    // flight while the next one is written
+    GLuint pbo = ctx->upload_pbos[ctx->upload_index];
+    ctx->upload_index = (ctx->upload_index + 1) % 2;
+
+    PGL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo));
+
+    // Orphan the previous storage to avoid waiting on the GPU
+    PGL_CHECK(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+
+    void* ptr;
+    PGL_CHECK(ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                     GL_MAP_WRITE_BIT |
+                                     GL_MAP_INVALIDATE_BUFFER_BIT));
+
+    if (ptr)
+    {
+        memcpy(ptr, bitmap, size);
+        PGL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+        ctx->stats.bytes_uploaded += size;
+
+        // The data pointer is an offset into the bound PBO
+        pgl_bind_texture(ctx, texture);
+
+        PGL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
+                                  pgl_format_map[texture->fmt],
+                                  GL_UNSIGNED_BYTE, NULL));
+    }
+
+    PGL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+    // Fall back to a synchronous update if mapping failed
+    if (!ptr)
+        pgl_update_texture(ctx, texture, x, y, w, h, bitmap);
 }
 
 int pgl_generate_mipmap(pgl_texture_t* texture, bool linear)
@@ -1947,7 +2619,15 @@ void pgl_destroy_texture(pgl_texture_t* tex)
 {
     PGL_ASSERT(tex);
 
-    pgl_bind_texture(tex->ctx, NULL);
+    if (tex->ctx->target == tex)
+        pgl_set_render_target(tex->ctx, NULL);
+
+    for (pgl_size_t i = 0; i < PGL_MAX_TEXTURE_UNITS; i++)
+    {
+        if (tex->ctx->textures[i] == tex)
+            pgl_bind_texture_unit(tex->ctx, NULL, i);
+    }
+
     PGL_CHECK(glDeleteTextures(1, &tex->id));
 
     if (tex->target)
@@ -1969,6 +2649,9 @@ void pgl_destroy_texture(pgl_texture_t* tex)
                 PGL_CHECK(glDeleteRenderbuffers(1, &tex->depth_rbo_msaa));
             }
         }
+
+        if (tex->stack)
+            PGL_FREE(tex->stack, tex->ctx->mem_ctx);
     }
 
     PGL_FREE(tex, tex->ctx->mem_ctx);
@@ -1997,23 +2680,182 @@ uint64_t pgl_get_texture_id(const pgl_texture_t* texture)
     return texture->id;
 }
 
+void pgl_resolve_target(pgl_texture_t* target)
+{
+    PGL_ASSERT(target);
+    PGL_ASSERT(target->target);
+
+    pgl_resolve_msaa(target);
+}
+
 void pgl_bind_texture(pgl_ctx_t* ctx, pgl_texture_t* texture)
+{
+    pgl_bind_texture_unit(ctx, texture, 0);
+}
+
+void pgl_bind_texture_unit(pgl_ctx_t* ctx, pgl_texture_t* texture, pgl_size_t unit)
 {
     PGL_ASSERT(ctx);
+    PGL_ASSERT(unit < PGL_MAX_TEXTURE_UNITS);
 
-    if (ctx->texture == texture)
+    // Multi-sampled render targets are resolved when they are sampled
+    if (texture && texture->unresolved)
+        pgl_resolve_msaa(texture);
+
+    if (ctx->textures[unit] == texture)
         return;
 
+    ctx->stats.texture_binds++;
+
+    // Unit 0 is always left active, since it is used by the rest of the library
+    if (0 != unit)
+        PGL_CHECK(glActiveTexture(GL_TEXTURE0 + unit));
+
     if (NULL != texture)
-    {
         PGL_CHECK(glBindTexture(GL_TEXTURE_2D, texture->id));
-        ctx->texture = texture;
-    }
     else
-    {
         PGL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
-        ctx->texture = NULL;
+
+    if (0 != unit)
+        PGL_CHECK(glActiveTexture(GL_TEXTURE0));
+
+    ctx->textures[unit] = texture;
+}
+
+pgl_atlas_t* pgl_create_atlas(pgl_ctx_t* ctx,
+                              pgl_format_t fmt, bool srgb,
+                              int32_t w, int32_t h,
+                              int32_t padding, bool smooth)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(padding >= 0);
+
+    if (w <= 0 || h <= 0)
+    {
+        PGL_LOG("Atlas dimensions must be positive (w: %i, h: %i)", w, h);
+        pgl_set_error(ctx, PGL_INVALID_TEXTURE_SIZE);
+        return NULL;
+    }
+
+    pgl_atlas_t* atlas = PGL_MALLOC(sizeof(pgl_atlas_t), ctx->mem_ctx);
+
+    if (!atlas)
+    {
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    memset(atlas, 0, sizeof(pgl_atlas_t));
+
+    atlas->ctx = ctx;
+    atlas->fmt = fmt;
+    atlas->srgb = srgb;
+    atlas->smooth = smooth;
+    atlas->w = w;
+    atlas->h = h;
+    atlas->padding = padding;
+
+    if (-1 == pgl_add_atlas_page(atlas))
+    {
+        PGL_FREE(atlas, ctx->mem_ctx);
+        return NULL;
+    }
+
+    return atlas;
+}
+
+void pgl_destroy_atlas(pgl_atlas_t* atlas)
+{
+    PGL_ASSERT(atlas);
+
+    for (pgl_size_t i = 0; i < atlas->page_count; i++)
+    {
+        pgl_destroy_texture(atlas->pages[i].texture);
+        PGL_FREE(atlas->pages[i].nodes, atlas->ctx->mem_ctx);
+    }
+
+    PGL_FREE(atlas, atlas->ctx->mem_ctx);
+}
+
+int pgl_add_to_atlas(pgl_atlas_t* atlas,
+                     int32_t w, int32_t h,
+                     const uint8_t* bitmap,
+                     pgl_region_t* region)
+{
+    PGL_ASSERT(atlas);
+    PGL_ASSERT(bitmap);
+    PGL_ASSERT(region);
+
+    // Padding is reserved to the right of and above each region
+    int32_t padded_w = w + atlas->padding;
+    int32_t padded_h = h + atlas->padding;
+
+    if (w <= 0 || h <= 0 || padded_w > atlas->w || padded_h > atlas->h)
+    {
+        PGL_LOG("Bitmap does not fit in atlas page (w: %i, h: %i)", w, h);
+        pgl_set_error(atlas->ctx, PGL_INVALID_TEXTURE_SIZE);
+        return -1;
+    }
+
+    int32_t x = 0, y = 0;
+    pgl_atlas_page_t* page = NULL;
+
+    // Try existing pages first, most recent last
+    for (pgl_size_t i = 0; i < atlas->page_count; i++)
+    {
+        if (pgl_pack_atlas_page(&atlas->pages[i], atlas->w, atlas->h,
+                                padded_w, padded_h, &x, &y))
+        {
+            page = &atlas->pages[i];
+            break;
+        }
+    }
+
+    if (!page)
+    {
+        if (atlas->page_count >= PGL_MAX_ATLAS_PAGES)
+        {
+            PGL_LOG("Texture atlas is full");
+            pgl_set_error(atlas->ctx, PGL_ATLAS_FULL);
+            return -1;
+        }
+
+        if (-1 == pgl_add_atlas_page(atlas))
+            return -1;
+
+        page = &atlas->pages[atlas->page_count - 1];
+
+        // A region that fits the page dimensions always fits an empty page
+        pgl_pack_atlas_page(page, atlas->w, atlas->h, padded_w, padded_h, &x, &y);
     }
+
+    pgl_update_texture(atlas->ctx, page->texture, x, y, w, h, bitmap);
+
+    region->texture = page->texture;
+    region->x = x;
+    region->y = y;
+    region->w = w;
+    region->h = h;
+    region->u0 = (float)x / (float)atlas->w;
+    region->v0 = (float)y / (float)atlas->h;
+    region->u1 = (float)(x + w) / (float)atlas->w;
+    region->v1 = (float)(y + h) / (float)atlas->h;
+
+    return 0;
+}
+
+pgl_size_t pgl_get_atlas_page_count(const pgl_atlas_t* atlas)
+{
+    PGL_ASSERT(atlas);
+    return atlas->page_count;
+}
+
+pgl_texture_t* pgl_get_atlas_page(const pgl_atlas_t* atlas, pgl_size_t index)
+{
+    PGL_ASSERT(atlas);
+    PGL_ASSERT(index < atlas->page_count);
+
+    return atlas->pages[index].texture;
 }
 
 int pgl_set_render_target(pgl_ctx_t* ctx, pgl_texture_t* target)
@@ -2023,36 +2865,45 @@ int pgl_set_render_target(pgl_ctx_t* ctx, pgl_texture_t* target)
     if (ctx->target == target)
         return 0;
 
-    if (ctx->target && ctx->samples > 0)
-    {
-        PGL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER,  ctx->target->fbo_msaa));
-        PGL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER,  ctx->target->fbo));
-        PGL_CHECK(glBlitFramebuffer(0, 0, ctx->target->w, ctx->target->h,
-                                    0, 0, ctx->target->w, ctx->target->h,
-                                    GL_COLOR_BUFFER_BIT,  GL_LINEAR));
-    }
+    bool first_use = false;
 
-    if (!target)
+    if (target)
     {
-        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        PGL_ASSERT(target->target);
 
-        ctx->target = NULL;
-        pgl_reset_last_state(ctx);
+        // The state stack is allocated when the texture is first used as a
+        // render target
+        if (!target->stack)
+        {
+            target->stack = PGL_MALLOC(sizeof(pgl_state_stack_t), ctx->mem_ctx);
 
-        return 0;
-    }
+            if (!target->stack)
+            {
+                pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+                return -1;
+            }
 
-    if (ctx->samples > 0)
-        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, target->fbo_msaa));
-    else
-        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, target->fbo));
+            first_use = true;
+        }
+
+        // The target will be resolved when it is next sampled
+        if (ctx->samples > 0)
+            target->unresolved = true;
+    }
 
     ctx->target = target;
+    pgl_bind_target_framebuffer(ctx);
 
-    pgl_clear_stack(ctx);
-    pgl_reset_state(ctx);
-    pgl_reset_last_state(ctx);
-    pgl_set_viewport(ctx, 0, 0, target->w, target->h);
+    // The state of the target is kept, but may differ from the state that
+    // was last applied
+    ctx->dirty = PGL_STATE_ALL;
+
+    if (first_use)
+    {
+        pgl_clear_stack(ctx);
+        pgl_reset_state(ctx);
+        pgl_set_viewport(ctx, 0, 0, target->w, target->h);
+    }
 
     return 0;
 }
@@ -2063,6 +2914,125 @@ void pgl_clear(float r, float g, float b, float a)
     PGL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 }
 
+pgl_readback_t* pgl_create_readback(pgl_ctx_t* ctx)
+{
+    PGL_ASSERT(ctx);
+
+    pgl_readback_t* readback = PGL_MALLOC(sizeof(pgl_readback_t), ctx->mem_ctx);
+
+    if (!readback)
+    {
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    readback->ctx = ctx;
+    readback->fence = NULL;
+    readback->size = 0;
+
+    PGL_CHECK(glGenBuffers(1, &readback->pbo));
+
+    return readback;
+}
+
+void pgl_destroy_readback(pgl_readback_t* readback)
+{
+    PGL_ASSERT(readback);
+
+    if (readback->fence)
+        PGL_CHECK(glDeleteSync(readback->fence));
+
+    PGL_CHECK(glDeleteBuffers(1, &readback->pbo));
+    PGL_FREE(readback, readback->ctx->mem_ctx);
+}
+
+int pgl_read_pixels_async(pgl_ctx_t* ctx,
+                          pgl_readback_t* readback,
+                          int32_t x, int32_t y,
+                          int32_t w, int32_t h)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(readback);
+
+    if (w <= 0 || h <= 0)
+    {
+        pgl_set_error(ctx, PGL_INVALID_VALUE);
+        return -1;
+    }
+
+    // Discard any pending request
+    if (readback->fence)
+    {
+        PGL_CHECK(glDeleteSync(readback->fence));
+        readback->fence = NULL;
+    }
+
+    readback->size = (pgl_size_t)w * (pgl_size_t)h * 4;
+
+    // Multi-sampled framebuffers can't be read directly, so read from the
+    // resolved framebuffer instead
+    pgl_texture_t* target = ctx->target;
+
+    if (target && ctx->samples > 0)
+    {
+        pgl_resolve_msaa(target);
+        PGL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER, target->fbo));
+    }
+
+    PGL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo));
+    PGL_CHECK(glBufferData(GL_PIXEL_PACK_BUFFER, readback->size, NULL, GL_STREAM_READ));
+    PGL_CHECK(glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+    PGL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    if (target && ctx->samples > 0)
+        pgl_bind_target_framebuffer(ctx);
+
+    PGL_CHECK(readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+    return 0;
+}
+
+bool pgl_poll_readback(pgl_readback_t* readback, uint8_t* pixels, bool wait)
+{
+    PGL_ASSERT(readback);
+    PGL_ASSERT(pixels);
+
+    if (!readback->fence)
+        return false;
+
+    GLenum status;
+
+    do
+    {
+        // Wait in 1ms increments if blocking
+        PGL_CHECK(status = glClientWaitSync(readback->fence,
+                                            GL_SYNC_FLUSH_COMMANDS_BIT,
+                                            wait ? 1000000 : 0));
+    } while (wait && GL_TIMEOUT_EXPIRED == status);
+
+    if (GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status)
+        return false;
+
+    PGL_CHECK(glDeleteSync(readback->fence));
+    readback->fence = NULL;
+
+    PGL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo));
+
+    const void* ptr;
+    PGL_CHECK(ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback->size,
+                                     GL_MAP_READ_BIT));
+
+    if (ptr)
+    {
+        memcpy(pixels, ptr, readback->size);
+        PGL_CHECK(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    }
+
+    PGL_CHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    return NULL != ptr;
+}
+
 void pgl_draw_array(pgl_ctx_t* ctx,
                    pgl_primitive_t primitive,
                    const pgl_vertex_t* vertices,
@@ -2084,7 +3054,9 @@ void pgl_draw_array(pgl_ctx_t* ctx,
     PGL_CHECK(glDrawArrays(pgl_primitive_map[primitive], 0, count));
     PGL_CHECK(glBindVertexArray(0));
 
-    pgl_after_draw(ctx);
+    ctx->stats.draw_calls++;
+    ctx->stats.vertices += count;
+    ctx->stats.bytes_uploaded += count * sizeof(pgl_vertex_t);
 }
 
 void pgl_draw_indexed_array(pgl_ctx_t* ctx,
@@ -2112,7 +3084,10 @@ void pgl_draw_indexed_array(pgl_ctx_t* ctx,
     PGL_CHECK(glDrawElements(pgl_primitive_map[primitive], index_count, GL_UNSIGNED_INT, 0));
     PGL_CHECK(glBindVertexArray(0));
 
-    pgl_after_draw(ctx);
+    ctx->stats.draw_calls++;
+    ctx->stats.vertices += index_count;
+    ctx->stats.bytes_uploaded += vertex_count * sizeof(pgl_vertex_t) +
+                                 index_count * sizeof(GLuint);
 }
 
 pgl_buffer_t* pgl_create_buffer(pgl_ctx_t* ctx,
@@ -2142,6 +3117,9 @@ pgl_buffer_t* pgl_create_buffer(pgl_ctx_t* ctx,
     pgl_bind_attributes();
     PGL_CHECK(glBindVertexArray(0));
 
+    ctx->stats.bytes_uploaded += count * sizeof(pgl_vertex_t);
+
+    buffer->ctx = ctx;
     buffer->primitive = pgl_primitive_map[primitive];
     buffer->count = count;
 
@@ -2161,6 +3139,8 @@ void pgl_sub_buffer_data(pgl_ctx_t* ctx,
     PGL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo));
     PGL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, count * sizeof(pgl_vertex_t), vertices));
 
+    ctx->stats.bytes_uploaded += count * sizeof(pgl_vertex_t);
+
     buffer->count = count;
 }
 
@@ -2192,20 +3172,174 @@ void pgl_draw_buffer(pgl_ctx_t* ctx,
     PGL_CHECK(glDrawArrays(buffer->primitive, start, count));
     PGL_CHECK(glBindVertexArray(0));
 
-    pgl_after_draw(ctx);
+    ctx->stats.draw_calls++;
+    ctx->stats.vertices += count;
 }
 
-void pgl_set_transpose(pgl_ctx_t* ctx, bool enabled)
+pgl_buffer_t* pgl_merge_buffers(pgl_ctx_t* ctx,
+                                pgl_buffer_t* const* buffers,
+                                pgl_size_t count,
+                                pgl_range_t* ranges)
 {
     PGL_ASSERT(ctx);
-    ctx->transpose = enabled;
-}
+    PGL_ASSERT(buffers);
+    PGL_ASSERT(count > 0);
+
+    pgl_size_t total = 0;
+
+    for (pgl_size_t i = 0; i < count; i++)
+    {
+        PGL_ASSERT(buffers[i]);
+
+        if (buffers[i]->primitive != buffers[0]->primitive)
+        {
+            PGL_LOG("Merged buffers must have the same primitive type");
+            pgl_set_error(ctx, PGL_INVALID_VALUE);
+            return NULL;
+        }
+
+        total += buffers[i]->count;
+    }
+
+    pgl_buffer_t* buffer = PGL_MALLOC(sizeof(pgl_buffer_t), ctx->mem_ctx);
+
+    if (!buffer)
+    {
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    PGL_CHECK(glGenVertexArrays(1, &buffer->vao));
+    PGL_CHECK(glGenBuffers(1, &buffer->vbo));
+
+    PGL_CHECK(glBindVertexArray(buffer->vao));
+
+    PGL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo));
+    PGL_CHECK(glBufferData(GL_ARRAY_BUFFER, total * sizeof(pgl_vertex_t), NULL, GL_STATIC_DRAW));
+
+    pgl_bind_attributes();
+    PGL_CHECK(glBindVertexArray(0));
+
+    // Copy the vertices of each buffer into consecutive ranges
+    PGL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->vbo));
+
+    pgl_size_t start = 0;
+
+    for (pgl_size_t i = 0; i < count; i++)
+    {
+        pgl_size_t size = buffers[i]->count;
+
+        if (size > 0)
+        {
+            PGL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, buffers[i]->vbo));
+            PGL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                          0, start * sizeof(pgl_vertex_t),
+                                          size * sizeof(pgl_vertex_t)));
+        }
+
+        if (ranges)
+        {
+            ranges[i].start = start;
+            ranges[i].count = size;
+        }
+
+        start += size;
+    }
+
+    PGL_CHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    PGL_CHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+
+    buffer->ctx = ctx;
+    buffer->primitive = buffers[0]->primitive;
+    buffer->count = total;
+
+    return buffer;
+}
+
+void pgl_draw_buffer_ranges(pgl_ctx_t* ctx,
+                            const pgl_buffer_t* buffer,
+                            const pgl_range_t* ranges,
+                            pgl_size_t range_count,
+                            pgl_texture_t* texture,
+                            pgl_shader_t* shader)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(buffer);
+    PGL_ASSERT(ranges);
+    PGL_ASSERT(shader);
+
+    pgl_before_draw(ctx, texture, shader);
+
+    PGL_CHECK(glBindVertexArray(buffer->vao));
+
+    // Ranges are submitted in batches, since glMultiDrawArrays takes separate
+    // arrays of starts and counts
+    GLint starts[PGL_MULTI_DRAW_BATCH_SIZE];
+    GLsizei counts[PGL_MULTI_DRAW_BATCH_SIZE];
+
+    pgl_size_t i = 0;
+
+    while (i < range_count)
+    {
+        GLsizei batch = 0;
+
+        for (; i < range_count && batch < PGL_MULTI_DRAW_BATCH_SIZE; i++)
+        {
+            PGL_ASSERT(ranges[i].start + ranges[i].count <= (pgl_size_t)buffer->count);
+
+            starts[batch] = ranges[i].start;
+            counts[batch] = ranges[i].count;
+            batch++;
+
+            ctx->stats.vertices += ranges[i].count;
+        }
+
+        // Not available in OpenGL ES
+        if (glMultiDrawArrays)
+        {
+            PGL_CHECK(glMultiDrawArrays(buffer->primitive, starts, counts, batch));
+            ctx->stats.draw_calls++;
+        }
+        else
+        {
+            for (GLsizei j = 0; j < batch; j++)
+                PGL_CHECK(glDrawArrays(buffer->primitive, starts[j], counts[j]));
+
+            ctx->stats.draw_calls += batch;
+        }
+    }
+
+    PGL_CHECK(glBindVertexArray(0));
+}
+
+void pgl_get_stats(const pgl_ctx_t* ctx, pgl_stats_t* stats)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(stats);
+
+    *stats = ctx->stats;
+    stats->error_checks = (pgl_size_t)(pgl_check_count - ctx->check_base);
+}
+
+void pgl_reset_stats(pgl_ctx_t* ctx)
+{
+    PGL_ASSERT(ctx);
+
+    memset(&ctx->stats, 0, sizeof(pgl_stats_t));
+    ctx->check_base = pgl_check_count;
+}
+
+void pgl_set_transpose(pgl_ctx_t* ctx, bool enabled)
+{
+    PGL_ASSERT(ctx);
+    ctx->transpose = enabled;
+}
 
 void pgl_set_blend_mode(pgl_ctx_t* ctx, pgl_blend_mode_t mode)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_BLEND);
     state->blend_mode = mode;
 }
 
@@ -2213,7 +3347,7 @@ void pgl_reset_blend_mode(pgl_ctx_t* ctx)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_BLEND);
 
     pgl_blend_mode_t mode = {
         PGL_SRC_ALPHA,
@@ -2232,7 +3366,7 @@ void pgl_set_transform(pgl_ctx_t* ctx, const pgl_m4_t matrix)
     PGL_ASSERT(ctx);
     PGL_ASSERT(matrix);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_TRANSFORM);
     memcpy(state->transform, matrix, sizeof(pgl_m4_t));
 }
 
@@ -2271,7 +3405,7 @@ void pgl_reset_transform(pgl_ctx_t* ctx)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_TRANSFORM);
 
     const pgl_m4_t matrix =
     {
@@ -2289,7 +3423,7 @@ void pgl_set_projection(pgl_ctx_t* ctx, const pgl_m4_t matrix)
     PGL_ASSERT(ctx);
     PGL_ASSERT(matrix);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_PROJECTION);
     memcpy(state->projection, matrix, sizeof(pgl_m4_t));
 }
 
@@ -2328,7 +3462,7 @@ void pgl_reset_projection(pgl_ctx_t* ctx)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_PROJECTION);
 
     const pgl_m4_t matrix =
     {
@@ -2346,7 +3480,7 @@ void pgl_set_viewport(pgl_ctx_t* ctx, int32_t x, int32_t y,
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_VIEWPORT);
     state->viewport = (pgl_viewport_t){ x, y, w, h };
 }
 
@@ -2354,7 +3488,7 @@ void pgl_reset_viewport(pgl_ctx_t* ctx) // TODO: get GL viewport?
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_VIEWPORT);
     state->viewport = (pgl_viewport_t){ 0, 0, ctx->w, ctx->h };
 }
 
@@ -2362,7 +3496,7 @@ void pgl_set_line_width(pgl_ctx_t* ctx, float width)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_LINE_WIDTH);
     state->line_width = width;
 }
 
@@ -2370,7 +3504,7 @@ void pgl_reset_line_width(pgl_ctx_t* ctx)
 {
     PGL_ASSERT(ctx);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    pgl_state_t* state = pgl_modify_state(ctx, PGL_STATE_LINE_WIDTH);
     state->line_width = 1.0f;
 }
 
@@ -2393,7 +3527,8 @@ void pgl_push_state(pgl_ctx_t* ctx)
     pgl_state_stack_t* stack = pgl_get_active_stack(ctx);
     PGL_ASSERT(stack->size < PGL_MAX_STATES);
 
-    stack->array[stack->size] = stack->state;
+    // Fields are saved lazily when they are first modified (copy-on-write)
+    stack->array[stack->size].saved = 0;
     stack->size++;
 }
 
@@ -2405,7 +3540,12 @@ void pgl_pop_state(pgl_ctx_t* ctx)
 
     PGL_ASSERT(stack->size > 0);
 
-    stack->state = stack->array[stack->size];
+    // Restore only the fields that were modified since the push
+    const pgl_state_frame_t* frame = &stack->array[stack->size - 1];
+
+    pgl_copy_state(&stack->state, &frame->state, frame->saved);
+    ctx->dirty |= frame->saved;
+
     stack->size--;
 }
 
@@ -2422,12 +3562,17 @@ void pgl_set_bool(pgl_shader_t* shader, const char* name, bool value)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { value };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform1i(uniform->location, value));
 }
 
@@ -2436,12 +3581,17 @@ void pgl_set_1i(pgl_shader_t* shader, const char* name, int32_t a)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { a };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform1i(uniform->location, a));
 }
 
@@ -2450,12 +3600,17 @@ void pgl_set_2i(pgl_shader_t* shader, const char* name, int32_t a, int32_t b)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { a, b };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform2i(uniform->location, a, b));
 }
 
@@ -2465,12 +3620,17 @@ void pgl_set_3i(pgl_shader_t* shader, const char* name, int32_t a, int32_t b,
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { a, b, c };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform3i(uniform->location, a, b, c));
 }
 
@@ -2480,12 +3640,17 @@ void pgl_set_4i(pgl_shader_t* shader, const char* name, int32_t a, int32_t b,
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { a, b, c, d };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform4i(uniform->location, a, b, c, d));
 }
 
@@ -2519,12 +3684,17 @@ void pgl_set_1f(pgl_shader_t* shader, const char* name, float x)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const float values[] = { x };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform1f(uniform->location, x));
 }
 
@@ -2533,12 +3703,17 @@ void pgl_set_2f(pgl_shader_t* shader, const char* name, float x, float y)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const float values[] = { x, y };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform2f(uniform->location, x, y));
 }
 
@@ -2547,12 +3722,17 @@ void pgl_set_3f(pgl_shader_t* shader, const char* name, float x, float y, float
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const float values[] = { x, y, z };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform3f(uniform->location, x, y, z));
 }
 
@@ -2562,12 +3742,17 @@ void pgl_set_4f(pgl_shader_t* shader, const char* name, float x, float y,
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const float values[] = { x, y, z, w };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform4f(uniform->location, x, y, z, w));
 }
 
@@ -2607,12 +3792,15 @@ void pgl_set_a1f(pgl_shader_t* shader,
     PGL_ASSERT(name);
     PGL_ASSERT(values);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    if (!pgl_shadow_uniform(shader, uniform, values, count * sizeof(float)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform1fv(uniform->location, count, values));
 }
 
@@ -2625,8 +3813,7 @@ void pgl_set_a2f(pgl_shader_t* shader,
     PGL_ASSERT(name);
     PGL_ASSERT(vec);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
@@ -2641,6 +3828,10 @@ void pgl_set_a2f(pgl_shader_t* shader,
         values[i + 1] = vec[j][1];
     }
 
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform2fv(uniform->location, count, values));
 }
 
@@ -2653,8 +3844,7 @@ void pgl_set_a3f(pgl_shader_t* shader,
     PGL_ASSERT(name);
     PGL_ASSERT(vec);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
@@ -2670,6 +3860,10 @@ void pgl_set_a3f(pgl_shader_t* shader,
         values[i + 2] = vec[j][2];
     }
 
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform3fv(uniform->location, count, values));
 }
 
@@ -2682,8 +3876,7 @@ void pgl_set_a4f(pgl_shader_t* shader,
     PGL_ASSERT(name);
     PGL_ASSERT(vec);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
@@ -2700,6 +3893,10 @@ void pgl_set_a4f(pgl_shader_t* shader,
         values[i + 3] = vec[j][3];
     }
 
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform4fv(uniform->location, count, values));
 }
 
@@ -2709,12 +3906,15 @@ void pgl_set_m2(pgl_shader_t* shader, const char* name, const pgl_m2_t matrix)
     PGL_ASSERT(name);
     PGL_ASSERT(matrix);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    if (!pgl_shadow_matrix(shader, uniform, matrix, uniform->size * sizeof(pgl_m2_t)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniformMatrix2fv(uniform->location, uniform->size, shader->ctx->transpose, (float*)matrix));
 }
 
@@ -2724,12 +3924,15 @@ void pgl_set_m3(pgl_shader_t* shader, const char* name, const pgl_m3_t matrix)
     PGL_ASSERT(name);
     PGL_ASSERT(matrix);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    if (!pgl_shadow_matrix(shader, uniform, matrix, uniform->size * sizeof(pgl_m3_t)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniformMatrix3fv(uniform->location, uniform->size, shader->ctx->transpose, (float*)matrix));
 }
 
@@ -2739,12 +3942,15 @@ void pgl_set_m4(pgl_shader_t* shader, const char* name, const pgl_m4_t matrix)
     PGL_ASSERT(name);
     PGL_ASSERT(matrix);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    if (!pgl_shadow_matrix(shader, uniform, matrix, uniform->size * sizeof(pgl_m4_t)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniformMatrix4fv(uniform->location, uniform->size, shader->ctx->transpose, (float*)matrix));
 }
 
@@ -2753,15 +3959,100 @@ void pgl_set_s2d(pgl_shader_t* shader, const char* name, int32_t value)
     PGL_ASSERT(shader);
     PGL_ASSERT(name);
 
-    pgl_bind_shader(shader->ctx, shader);
-    const pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
+    pgl_uniform_t* uniform = pgl_find_uniform(shader, name);
 
     if (!uniform)
         return;
 
+    const int32_t values[] = { value };
+
+    if (!pgl_shadow_uniform(shader, uniform, values, sizeof(values)))
+        return;
+
+    pgl_bind_shader(shader->ctx, shader);
     PGL_CHECK(glUniform1i(uniform->location, value));
 }
 
+pgl_uniform_buffer_t* pgl_create_uniform_buffer(pgl_ctx_t* ctx,
+                                                pgl_size_t size,
+                                                const void* data)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(size > 0);
+
+    pgl_uniform_buffer_t* buffer = PGL_MALLOC(sizeof(pgl_uniform_buffer_t), ctx->mem_ctx);
+
+    if (!buffer)
+    {
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    buffer->ctx = ctx;
+    buffer->size = size;
+
+    PGL_CHECK(glGenBuffers(1, &buffer->id));
+    PGL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, buffer->id));
+    PGL_CHECK(glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW));
+    PGL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+    if (data)
+        ctx->stats.bytes_uploaded += size;
+
+    return buffer;
+}
+
+void pgl_destroy_uniform_buffer(pgl_uniform_buffer_t* buffer)
+{
+    PGL_ASSERT(buffer);
+
+    PGL_CHECK(glDeleteBuffers(1, &buffer->id));
+    PGL_FREE(buffer, buffer->ctx->mem_ctx);
+}
+
+void pgl_update_uniform_buffer(pgl_uniform_buffer_t* buffer,
+                               pgl_size_t offset,
+                               pgl_size_t size,
+                               const void* data)
+{
+    PGL_ASSERT(buffer);
+    PGL_ASSERT(data);
+    PGL_ASSERT(offset + size <= buffer->size);
+
+    PGL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, buffer->id));
+    PGL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data));
+    PGL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+    buffer->ctx->stats.bytes_uploaded += size;
+}
+
+void pgl_bind_uniform_buffer(pgl_uniform_buffer_t* buffer, pgl_size_t binding)
+{
+    PGL_ASSERT(buffer);
+
+    PGL_CHECK(glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer->id));
+}
+
+int pgl_set_uniform_block(pgl_shader_t* shader, const char* name, pgl_size_t binding)
+{
+    PGL_ASSERT(shader);
+    PGL_ASSERT(name);
+
+    GLuint index;
+    PGL_CHECK(index = glGetUniformBlockIndex(shader->program, name));
+
+    if (GL_INVALID_INDEX == index)
+    {
+        PGL_LOG("Uniform block not found: %s", name);
+        pgl_set_error(shader->ctx, PGL_INVALID_UNIFORM_NAME);
+        return -1;
+    }
+
+    PGL_CHECK(glUniformBlockBinding(shader->program, index, binding));
+
+    return 0;
+}
+
 /*=============================================================================
  * Internal API implementation
  *============================================================================*/
@@ -2806,23 +4097,6 @@ static const char* pgl_get_default_frag_shader()
     }
 }
 
-static void pgl_reset_last_state(pgl_ctx_t* ctx)
-{
-    PGL_ASSERT(ctx);
-
-    pgl_state_t* last = &ctx->last_state;
-
-    memset(last, 0, sizeof(pgl_state_t));
-
-    pgl_blend_mode_t mode =
-    {
-        PGL_FACTOR_COUNT, PGL_FACTOR_COUNT, PGL_EQ_COUNT,
-        PGL_FACTOR_COUNT, PGL_FACTOR_COUNT, PGL_EQ_COUNT
-    };
-
-    last->blend_mode = mode;
-}
-
 static pgl_state_stack_t* pgl_get_active_stack(pgl_ctx_t* ctx)
 {
     PGL_ASSERT(ctx);
@@ -2830,7 +4104,7 @@ static pgl_state_stack_t* pgl_get_active_stack(pgl_ctx_t* ctx)
     pgl_state_stack_t* stack = &ctx->stack;
 
     if (ctx->target)
-        stack = &ctx->target_stack;
+        stack = ctx->target->stack;
 
     return stack;
 }
@@ -2842,13 +4116,56 @@ static pgl_state_t* pgl_get_active_state(pgl_ctx_t* ctx)
     return &pgl_get_active_stack(ctx)->state;
 }
 
-static void pgl_apply_blend(pgl_ctx_t* ctx, const pgl_blend_mode_t* mode)
+// Returns the active state for modification. The modified fields are marked
+// dirty, and saved in the top stack frame if this is their first modification
+// since the last push
+static pgl_state_t* pgl_modify_state(pgl_ctx_t* ctx, uint32_t fields)
 {
     PGL_ASSERT(ctx);
-    PGL_ASSERT(mode);
 
-    if (pgl_mem_equal(mode, &ctx->last_state.blend_mode, sizeof(pgl_blend_mode_t)))
-        return;
+    pgl_state_stack_t* stack = pgl_get_active_stack(ctx);
+
+    if (stack->size > 0)
+    {
+        pgl_state_frame_t* frame = &stack->array[stack->size - 1];
+        uint32_t unsaved = fields & ~frame->saved;
+
+        if (unsaved)
+        {
+            pgl_copy_state(&frame->state, &stack->state, unsaved);
+            frame->saved |= unsaved;
+        }
+    }
+
+    ctx->dirty |= fields;
+
+    return &stack->state;
+}
+
+static void pgl_copy_state(pgl_state_t* dst, const pgl_state_t* src, uint32_t fields)
+{
+    PGL_ASSERT(dst);
+    PGL_ASSERT(src);
+
+    if (fields & PGL_STATE_BLEND)
+        dst->blend_mode = src->blend_mode;
+
+    if (fields & PGL_STATE_TRANSFORM)
+        memcpy(dst->transform, src->transform, sizeof(pgl_m4_t));
+
+    if (fields & PGL_STATE_PROJECTION)
+        memcpy(dst->projection, src->projection, sizeof(pgl_m4_t));
+
+    if (fields & PGL_STATE_VIEWPORT)
+        dst->viewport = src->viewport;
+
+    if (fields & PGL_STATE_LINE_WIDTH)
+        dst->line_width = src->line_width;
+}
+
+static void pgl_apply_blend(const pgl_blend_mode_t* mode)
+{
+    PGL_ASSERT(mode);
 
     PGL_CHECK(glBlendFuncSeparate(pgl_blend_factor_map[mode->color_src],
                                   pgl_blend_factor_map[mode->color_dst],
@@ -2864,9 +4181,7 @@ static void pgl_apply_transform(pgl_ctx_t* ctx, const pgl_m4_t matrix)
     PGL_ASSERT(ctx);
     PGL_ASSERT(matrix);
 
-    if (pgl_mem_equal(matrix, ctx->last_state.transform, sizeof(pgl_m4_t)))
-        return;
-
+    // Redundant uploads are filtered by the shader's uniform shadow
     pgl_set_m4(ctx->shader, "u_transform", matrix);
 }
 
@@ -2875,33 +4190,22 @@ static void pgl_apply_projection(pgl_ctx_t* ctx, const pgl_m4_t matrix)
     PGL_ASSERT(ctx);
     PGL_ASSERT(matrix);
 
-    if (pgl_mem_equal(matrix, &ctx->last_state.projection, sizeof(pgl_m4_t)))
-        return;
-
+    // Redundant uploads are filtered by the shader's uniform shadow
     pgl_set_m4(ctx->shader, "u_projection", matrix);
 }
 
-static void pgl_apply_viewport(pgl_ctx_t* ctx, const pgl_viewport_t* viewport)
+static void pgl_apply_viewport(const pgl_viewport_t* viewport)
 {
-    PGL_ASSERT(ctx);
     PGL_ASSERT(viewport);
 
     if (viewport->w <= 0 && viewport->h <= 0)
         return;
 
-    if (pgl_mem_equal(viewport, &ctx->last_state.viewport, sizeof(pgl_viewport_t)))
-        return;
-
     PGL_CHECK(glViewport(viewport->x, viewport->y, viewport->w, viewport->h));
 }
 
-static void pgl_apply_line_width(pgl_ctx_t* ctx, float line_width)
+static void pgl_apply_line_width(float line_width)
 {
-    PGL_ASSERT(ctx);
-
-    if (line_width == ctx->last_state.line_width)
-        return;
-
     PGL_CHECK(glLineWidth(line_width));
 }
 
@@ -2913,13 +4217,40 @@ static void pgl_before_draw(pgl_ctx_t* ctx, pgl_texture_t* texture, pgl_shader_t
     pgl_bind_texture(ctx, texture);
     pgl_bind_shader(ctx, shader);
 
-    pgl_state_t* state = pgl_get_active_state(ctx);
+    // The matrices are uniforms, so they must be applied to a new shader
+    if (ctx->draw_shader != shader)
+    {
+        ctx->dirty |= PGL_STATE_TRANSFORM | PGL_STATE_PROJECTION;
+        ctx->draw_shader = shader;
+    }
+
+    // Only apply the state that changed since the last draw
+    const pgl_state_t* state = pgl_get_active_state(ctx);
+
+    for (uint32_t field = 1; field & PGL_STATE_ALL; field <<= 1)
+    {
+        if (ctx->dirty & field)
+            ctx->stats.state_applies++;
+        else
+            ctx->stats.state_skips++;
+    }
+
+    if (ctx->dirty & PGL_STATE_VIEWPORT)
+        pgl_apply_viewport(&state->viewport);
+
+    if (ctx->dirty & PGL_STATE_BLEND)
+        pgl_apply_blend(&state->blend_mode);
+
+    if (ctx->dirty & PGL_STATE_TRANSFORM)
+        pgl_apply_transform(ctx, state->transform);
+
+    if (ctx->dirty & PGL_STATE_PROJECTION)
+        pgl_apply_projection(ctx, state->projection);
+
+    if (ctx->dirty & PGL_STATE_LINE_WIDTH)
+        pgl_apply_line_width(state->line_width);
 
-    pgl_apply_viewport(ctx, &state->viewport);
-    pgl_apply_blend(ctx, &state->blend_mode);
-    pgl_apply_transform(ctx, state->transform);
-    pgl_apply_projection(ctx, state->projection);
-    pgl_apply_line_width(ctx, state->line_width);
+    ctx->dirty = 0;
 
     glEnable(GL_BLEND);
 
@@ -2934,11 +4265,226 @@ static void pgl_before_draw(pgl_ctx_t* ctx, pgl_texture_t* texture, pgl_shader_t
         PGL_CHECK(glDisable(GL_FRAMEBUFFER_SRGB));
 }
 
-static void pgl_after_draw(pgl_ctx_t* ctx)
+static GLuint pgl_compile_program(pgl_ctx_t* ctx, const char* vert_src,
+                                                  const char* frag_src)
 {
     PGL_ASSERT(ctx);
+    PGL_ASSERT(vert_src);
+    PGL_ASSERT(frag_src);
+
+    // Create shaders
+    GLuint vs, fs, program;
+
+    PGL_CHECK(vs = glCreateShader(GL_VERTEX_SHADER));
+    PGL_CHECK(fs = glCreateShader(GL_FRAGMENT_SHADER));
+
+    GLsizei length;
+    GLchar msg[2048];
+
+    // Compile vertex shader
+    GLint is_compiled = GL_FALSE;
+
+    PGL_CHECK(glShaderSource(vs, 1, &vert_src, NULL));
+    PGL_CHECK(glCompileShader(vs));
+    PGL_CHECK(glGetShaderiv(vs, GL_COMPILE_STATUS, &is_compiled));
+
+    if (GL_FALSE == is_compiled)
+    {
+        PGL_CHECK(glGetShaderInfoLog(vs, sizeof(msg), &length, msg));
+        PGL_CHECK(glDeleteShader(vs));
+        PGL_LOG("Error compiling vertex shader: %s", msg);
+        pgl_set_error(ctx, PGL_SHADER_COMPILATION_ERROR);
+        return 0;
+    }
+
+    // Compile fragment shader
+    is_compiled = GL_FALSE;
+
+    PGL_CHECK(glShaderSource(fs, 1, &frag_src, NULL));
+    PGL_CHECK(glCompileShader(fs));
+    PGL_CHECK(glGetShaderiv(fs, GL_COMPILE_STATUS, &is_compiled));
+
+    if (GL_FALSE == is_compiled)
+    {
+        PGL_CHECK(glGetShaderInfoLog(fs, sizeof(msg), &length, msg));
+        PGL_CHECK(glDeleteShader(vs));
+        PGL_CHECK(glDeleteShader(fs));
+        PGL_LOG("Error compiling fragment shader: %s", msg);
+        pgl_set_error(ctx, PGL_SHADER_COMPILATION_ERROR);
+        return 0;
+    }
+
+    // Link program
+    GLint is_linked = GL_FALSE;
+
+    PGL_CHECK(program = glCreateProgram());
+
+    PGL_CHECK(glAttachShader(program, vs));
+    PGL_CHECK(glAttachShader(program, fs));
+
+    // Allow the linked program to be retrieved for the cache
+    if (ctx->cache_path)
+        PGL_CHECK(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                      GL_TRUE));
+
+    PGL_CHECK(glLinkProgram(program));
+    PGL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &is_linked));
+
+    PGL_CHECK(glDetachShader(program, vs));
+    PGL_CHECK(glDetachShader(program, fs));
+    PGL_CHECK(glDeleteShader(vs));
+    PGL_CHECK(glDeleteShader(fs));
+
+    if (GL_FALSE == is_linked)
+    {
+        PGL_CHECK(glGetProgramInfoLog(program, sizeof(msg), &length, msg));
+        PGL_CHECK(glDeleteProgram(program));
+        PGL_LOG("Error linking shader program: %s", msg);
+        pgl_set_error(ctx, PGL_SHADER_LINKING_ERROR);
+        return 0;
+    }
+
+    return program;
+}
+
+static uint64_t pgl_hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (uint64_t)bytes[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+static uint64_t pgl_hash_program(const char* vert_src, const char* frag_src)
+{
+    PGL_ASSERT(vert_src);
+    PGL_ASSERT(frag_src);
+
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+
+    // Terminators are included to separate the strings
+    uint64_t hash = 0xCBF29CE484222325;
+
+    if (renderer)
+        hash = pgl_hash_bytes(hash, renderer, strlen(renderer) + 1);
+
+    if (version)
+        hash = pgl_hash_bytes(hash, version, strlen(version) + 1);
+
+    hash = pgl_hash_bytes(hash, vert_src, strlen(vert_src) + 1);
+    hash = pgl_hash_bytes(hash, frag_src, strlen(frag_src) + 1);
+
+    return hash;
+}
+
+// Writes the path of a cache file into the context's path buffer
+static const char* pgl_get_cache_path(pgl_ctx_t* ctx, uint64_t key)
+{
+    PGL_ASSERT(ctx);
+    PGL_ASSERT(ctx->cache_path);
+
+    snprintf(ctx->cache_path + ctx->cache_dir_length, PGL_CACHE_NAME_LENGTH,
+             "%016llx.bin", (unsigned long long)key);
+
+    return ctx->cache_path;
+}
+
+static GLuint pgl_load_program_binary(pgl_ctx_t* ctx, uint64_t key)
+{
+    PGL_ASSERT(ctx);
+
+    FILE* file = fopen(pgl_get_cache_path(ctx, key), "rb");
+
+    if (!file)
+        return 0;
+
+    uint32_t header[3]; // Magic number, binary format, and length
+
+    if (1 != fread(header, sizeof(header), 1, file) ||
+        PGL_CACHE_MAGIC != header[0] || 0 == header[2])
+    {
+        fclose(file);
+        return 0;
+    }
+
+    void* binary = PGL_MALLOC(header[2], ctx->mem_ctx);
+
+    if (!binary)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    size_t count = fread(binary, header[2], 1, file);
+
+    fclose(file);
+
+    GLuint program = 0;
+
+    if (1 == count)
+    {
+        GLint is_linked = GL_FALSE;
+
+        PGL_CHECK(program = glCreateProgram());
+        PGL_CHECK(glProgramBinary(program, header[1], binary, header[2]));
+        PGL_CHECK(glGetProgramiv(program, GL_LINK_STATUS, &is_linked));
+
+        // The binary is rejected if the driver changed since it was saved
+        if (GL_FALSE == is_linked)
+        {
+            PGL_CHECK(glDeleteProgram(program));
+            program = 0;
+        }
+    }
+
+    PGL_FREE(binary, ctx->mem_ctx);
+
+    return program;
+}
+
+static void pgl_save_program_binary(pgl_ctx_t* ctx, GLuint program, uint64_t key)
+{
+    PGL_ASSERT(ctx);
+
+    GLint length = 0;
+    PGL_CHECK(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+
+    if (length <= 0)
+        return;
+
+    void* binary = PGL_MALLOC(length, ctx->mem_ctx);
+
+    if (!binary)
+        return;
+
+    GLenum format;
+    PGL_CHECK(glGetProgramBinary(program, length, &length, &format, binary));
+
+    uint32_t header[3] = { PGL_CACHE_MAGIC, format, (uint32_t)length };
+
+    const char* path = pgl_get_cache_path(ctx, key);
+    FILE* file = fopen(path, "wb");
+
+    if (file)
+    {
+        bool written = 1 == fwrite(header, sizeof(header), 1, file) &&
+                       1 == fwrite(binary, length, 1, file);
+
+        // Truncated files are rejected when loading, but are removed anyway
+        if (0 != fclose(file) || !written)
+        {
+            PGL_LOG("Failed to write shader cache file: %s", path);
+            remove(path);
+        }
+    }
 
-    ctx->last_state = *pgl_get_active_state(ctx);
+    PGL_FREE(binary, ctx->mem_ctx);
 }
 
 static int pgl_load_uniforms(pgl_shader_t* shader)
@@ -2948,16 +4494,7 @@ static int pgl_load_uniforms(pgl_shader_t* shader)
     // Get number of active uniforms
     GLint uniform_count;
     glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &uniform_count);
-    shader->uniform_count = uniform_count;
-
-    // Validate number of uniforms
-    PGL_ASSERT(uniform_count < PGL_MAX_UNIFORMS);
-
-    if (uniform_count >= PGL_MAX_UNIFORMS)
-    {
-        pgl_set_error(shader->ctx, PGL_INVALID_UNIFORM_COUNT);
-        return -1;
-    }
+    shader->uniform_count = 0;
 
     // Loop through active uniforms and add them to the uniform array
     for (GLint i = 0; i < uniform_count; i++)
@@ -2965,6 +4502,9 @@ static int pgl_load_uniforms(pgl_shader_t* shader)
         pgl_uniform_t uniform;
         GLsizei name_length;
 
+        // Nothing is cached yet and the shadow value is never indeterminate
+        memset(&uniform, 0, sizeof(pgl_uniform_t));
+
         // Uniform index
         GLint index = i;
 
@@ -2986,29 +4526,42 @@ static int pgl_load_uniforms(pgl_shader_t* shader)
         // Get uniform location
         uniform.location = glGetUniformLocation(shader->program, uniform.name);
 
+        // Uniforms declared in named blocks are set using uniform buffers
+        if (-1 == uniform.location)
+            continue;
+
+        // Validate number of uniforms
+        PGL_ASSERT(shader->uniform_count < PGL_MAX_UNIFORMS);
+
+        if (shader->uniform_count >= PGL_MAX_UNIFORMS)
+        {
+            pgl_set_error(shader->ctx, PGL_INVALID_UNIFORM_COUNT);
+            return -1;
+        }
+
         // Hash name for fast lookups
         uniform.hash = pgl_hash_str(uniform.name);
 
         // Store uniform in the array
-        shader->uniforms[i] = uniform;
+        shader->uniforms[shader->uniform_count++] = uniform;
     }
 
 	return 0;
 }
 
-static const pgl_uniform_t* pgl_find_uniform(const pgl_shader_t* shader, const char* name)
+static pgl_uniform_t* pgl_find_uniform(pgl_shader_t* shader, const char* name)
 {
     PGL_ASSERT(shader);
     PGL_ASSERT(name && strlen(name) > 0);
 
 	pgl_size_t uniform_count = shader->uniform_count;
-	const pgl_uniform_t* uniforms = shader->uniforms;
+	pgl_uniform_t* uniforms = shader->uniforms;
 
 	uint64_t hash = pgl_hash_str(name);
 
 	for (pgl_size_t i = 0; i < uniform_count; i++)
 	{
-		const pgl_uniform_t* uniform = &uniforms[i];
+		pgl_uniform_t* uniform = &uniforms[i];
 
 		if (uniform->hash == hash && pgl_str_equal(name, uniform->name))
 		{
@@ -3019,6 +4572,218 @@ static const pgl_uniform_t* pgl_find_uniform(const pgl_shader_t* shader, const c
     return NULL;
 }
 
+// Compares a uniform value against the shadow copy of the last value uploaded
+// to the shader. Returns true (and updates the shadow) if the value changed
+static bool pgl_shadow_uniform(const pgl_shader_t* shader, pgl_uniform_t* uniform,
+                               const void* data, size_t size)
+{
+    PGL_ASSERT(shader);
+    PGL_ASSERT(uniform);
+    PGL_ASSERT(data);
+
+    pgl_stats_t* stats = &shader->ctx->stats;
+
+    // Values that don't fit in the shadow (e.g. large arrays) always upload
+    if (size > sizeof(uniform->cache))
+    {
+        uniform->cached = false;
+        stats->uniform_sets++;
+        return true;
+    }
+
+    if (uniform->cached && pgl_mem_equal(uniform->cache, data, size))
+    {
+        stats->uniform_skips++;
+        return false;
+    }
+
+    memcpy(uniform->cache, data, size);
+    uniform->cached = true;
+    stats->uniform_sets++;
+
+    return true;
+}
+
+// Matrix variant of `pgl_shadow_uniform`. A change in the context's transpose
+// flag invalidates the shadow
+static bool pgl_shadow_matrix(const pgl_shader_t* shader, pgl_uniform_t* uniform,
+                              const void* data, size_t size)
+{
+    PGL_ASSERT(shader);
+    PGL_ASSERT(uniform);
+
+    if (uniform->transpose != shader->ctx->transpose)
+    {
+        uniform->transpose = shader->ctx->transpose;
+        uniform->cached = false;
+    }
+
+    return pgl_shadow_uniform(shader, uniform, data, size);
+}
+
+static int pgl_add_atlas_page(pgl_atlas_t* atlas)
+{
+    PGL_ASSERT(atlas);
+    PGL_ASSERT(atlas->page_count < PGL_MAX_ATLAS_PAGES);
+
+    pgl_ctx_t* ctx = atlas->ctx;
+    pgl_atlas_page_t* page = &atlas->pages[atlas->page_count];
+
+    page->texture = pgl_create_texture(ctx, false, atlas->fmt, atlas->srgb,
+                                       atlas->w, atlas->h, atlas->smooth, false);
+
+    if (!page->texture)
+        return -1;
+
+    // Every node is at least one pixel wide, so the skyline never has more
+    // nodes than the page is wide
+    page->nodes = PGL_MALLOC((atlas->w + 1) * sizeof(pgl_skyline_node_t), ctx->mem_ctx);
+
+    if (!page->nodes)
+    {
+        pgl_destroy_texture(page->texture);
+        pgl_set_error(ctx, PGL_OUT_OF_MEMORY);
+        return -1;
+    }
+
+    page->nodes[0] = (pgl_skyline_node_t){ 0, 0, atlas->w };
+    page->node_count = 1;
+
+    atlas->page_count++;
+
+    return 0;
+}
+
+// Bottom-left skyline packing: the rectangle is placed on the segment that
+// minimizes its top edge, breaking ties by choosing the narrowest segment
+static bool pgl_pack_atlas_page(pgl_atlas_page_t* page, int32_t page_w, int32_t page_h,
+                                int32_t w, int32_t h, int32_t* x, int32_t* y)
+{
+    PGL_ASSERT(page);
+
+    pgl_size_t best_index = 0;
+    int32_t best_top = INT32_MAX;
+    int32_t best_w = INT32_MAX;
+    int32_t best_y = 0;
+
+    for (pgl_size_t i = 0; i < page->node_count; i++)
+    {
+        int32_t node_y = pgl_skyline_fit(page, i, page_w, page_h, w, h);
+
+        if (node_y < 0)
+            continue;
+
+        int32_t top = node_y + h;
+
+        if (top < best_top || (top == best_top && page->nodes[i].w < best_w))
+        {
+            best_index = i;
+            best_top = top;
+            best_w = page->nodes[i].w;
+            best_y = node_y;
+        }
+    }
+
+    if (INT32_MAX == best_top)
+        return false;
+
+    *x = page->nodes[best_index].x;
+    *y = best_y;
+
+    pgl_skyline_insert(page, best_index, *x, *y, w, h);
+
+    return true;
+}
+
+// Returns the height at which a rectangle fits on the skyline starting at the
+// specified node, or -1 if it doesn't fit
+static int32_t pgl_skyline_fit(const pgl_atlas_page_t* page, pgl_size_t index,
+                               int32_t page_w, int32_t page_h, int32_t w, int32_t h)
+{
+    PGL_ASSERT(page);
+
+    const pgl_skyline_node_t* nodes = page->nodes;
+
+    if (nodes[index].x + w > page_w)
+        return -1;
+
+    int32_t y = 0;
+    int32_t remaining = w;
+
+    for (pgl_size_t i = index; remaining > 0; i++)
+    {
+        PGL_ASSERT(i < page->node_count);
+
+        if (nodes[i].y > y)
+            y = nodes[i].y;
+
+        if (y + h > page_h)
+            return -1;
+
+        remaining -= nodes[i].w;
+    }
+
+    return y;
+}
+
+static void pgl_skyline_insert(pgl_atlas_page_t* page, pgl_size_t index,
+                               int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    PGL_ASSERT(page);
+
+    pgl_skyline_node_t* nodes = page->nodes;
+
+    // Insert the new segment
+    memmove(&nodes[index + 1], &nodes[index],
+            (page->node_count - index) * sizeof(pgl_skyline_node_t));
+
+    nodes[index] = (pgl_skyline_node_t){ x, y + h, w };
+    page->node_count++;
+
+    // Shrink or remove the segments covered by the new segment
+    pgl_size_t i = index + 1;
+
+    while (i < page->node_count)
+    {
+        int32_t right = nodes[i - 1].x + nodes[i - 1].w;
+
+        if (nodes[i].x >= right)
+            break;
+
+        int32_t overlap = right - nodes[i].x;
+
+        if (nodes[i].w > overlap)
+        {
+            nodes[i].x += overlap;
+            nodes[i].w -= overlap;
+            break;
+        }
+
+        memmove(&nodes[i], &nodes[i + 1],
+                (page->node_count - i - 1) * sizeof(pgl_skyline_node_t));
+
+        page->node_count--;
+    }
+
+    // Merge adjacent segments of equal height
+    for (i = 0; i + 1 < page->node_count; )
+    {
+        if (nodes[i].y == nodes[i + 1].y)
+        {
+            nodes[i].w += nodes[i + 1].w;
+
+            memmove(&nodes[i + 1], &nodes[i + 2],
+                    (page->node_count - i - 2) * sizeof(pgl_skyline_node_t));
+
+            page->node_count--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
 static void pgl_bind_attributes()
 {
     // Position
@@ -3044,6 +4809,43 @@ static void pgl_bind_attributes()
 
 }
 
+// Resolves a multi-sampled render target into its texture if it has been
+// rendered to since it was last resolved
+static void pgl_resolve_msaa(pgl_texture_t* target)
+{
+    PGL_ASSERT(target);
+
+    if (!target->unresolved)
+        return;
+
+    PGL_CHECK(glBindFramebuffer(GL_READ_FRAMEBUFFER,  target->fbo_msaa));
+    PGL_CHECK(glBindFramebuffer(GL_DRAW_FRAMEBUFFER,  target->fbo));
+    PGL_CHECK(glBlitFramebuffer(0, 0, target->w, target->h,
+                                0, 0, target->w, target->h,
+                                GL_COLOR_BUFFER_BIT,  GL_LINEAR));
+
+    // The current target may still be drawn to after being resolved
+    target->unresolved = (target->ctx->target == target);
+
+    pgl_bind_target_framebuffer(target->ctx);
+}
+
+// Binds the framebuffer of the current render target, or the default
+// framebuffer if there is none
+static void pgl_bind_target_framebuffer(pgl_ctx_t* ctx)
+{
+    PGL_ASSERT(ctx);
+
+    pgl_texture_t* target = ctx->target;
+
+    if (!target)
+        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    else if (ctx->samples > 0)
+        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, target->fbo_msaa));
+    else
+        PGL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, target->fbo));
+}
+
 static void pgl_log(const char* fmt, ...)
 {
     PGL_ASSERT(fmt);
@@ -3060,6 +4862,13 @@ static void pgl_log_error(const char* file, unsigned line, const char* expr)
 {
     PGL_ASSERT(file);
 
+    pgl_check_count++;
+
+    // Errors are reported by the debug message callback instead. Library calls
+    // are made with the OpenGL context of one of the live contexts current
+    if (pgl_context_count > 0 && pgl_debug_context_count == pgl_context_count)
+        return;
+
     pgl_error_t code = pgl_map_error(glGetError());
 
     if (PGL_NO_ERROR == code)
@@ -3069,6 +4878,66 @@ static void pgl_log_error(const char* file, unsigned line, const char* expr)
     file, line, pgl_error_msg_map[code], expr);
 }
 
+#ifndef NDEBUG
+
+static void pgl_leave_breadcrumb(const char* file, unsigned line, const char* expr)
+{
+    pgl_breadcrumb.file = file;
+    pgl_breadcrumb.line = line;
+    pgl_breadcrumb.expr = expr;
+}
+
+// Installs the debug message callback for the current OpenGL context. Returns
+// true if errors will be reported through it
+static bool pgl_enable_debug_output(pgl_ctx_t* ctx)
+{
+    if (!GLAD_GL_KHR_debug)
+        return false;
+
+    // Non-debug contexts are not required to emit any messages
+    GLint flags = 0;
+    PGL_CHECK(glGetIntegerv(GL_CONTEXT_FLAGS, &flags));
+
+    if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+        return false;
+
+    // Only errors are reported
+    PGL_CHECK(glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE,
+                                    0, NULL, GL_FALSE));
+
+    PGL_CHECK(glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE,
+                                    0, NULL, GL_TRUE));
+
+    PGL_CHECK(glDebugMessageCallback(pgl_debug_callback, ctx));
+    PGL_CHECK(glEnable(GL_DEBUG_OUTPUT));
+
+    // Messages are delivered on the calling thread before the offending call
+    // returns, so the breadcrumb always refers to that call
+    PGL_CHECK(glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS));
+
+    return true;
+}
+
+static void APIENTRY pgl_debug_callback(GLenum source, GLenum type, GLuint id,
+                                        GLenum severity, GLsizei length,
+                                        const GLchar* message,
+                                        const void* user_param)
+{
+    (void)source;
+    (void)id;
+    (void)severity;
+    (void)length;
+    (void)user_param;
+
+    if (GL_DEBUG_TYPE_ERROR != type)
+        return;
+
+    PGL_LOG("GL error: msg: \"%s\", last call: file: %s, line: %u, expr: \"%s\"",
+            message, pgl_breadcrumb.file, pgl_breadcrumb.line, pgl_breadcrumb.expr);
+}
+
+#endif // NDEBUG
+
 static pgl_error_t pgl_map_error(GLenum id)
 {
     switch (id)
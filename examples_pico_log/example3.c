@@ -1,3 +1,6 @@
+// Required for sub-second timestamps on POSIX systems
+#define _POSIX_C_SOURCE 199309L
+
 #define PICO_LOG_IMPLEMENTATION
 #include "../pico_log.h"
 
@@ -11,10 +14,16 @@ int main(int argc, char** argv)
     log_appender_t id = log_add_stream(stdout, LOG_LEVEL_TRACE);
 
     log_set_time_fmt(id, "%H:%M:%S");
+    log_set_time_precision(id, 3);
     log_display_colors(id, true);
     log_display_timestamp(id, true);
     log_display_file(id, true);
 
+    // Emit the same entries as JSON lines
+    log_appender_t json_id = log_add_stream(stdout, LOG_LEVEL_TRACE);
+
+    log_set_format(json_id, LOG_FORMAT_JSON);
+
     // Default log level is INFO
 
     log_trace ("Test message: %d", 0);
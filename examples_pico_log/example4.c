@@ -0,0 +1,79 @@
+#define PICO_LOG_IMPLEMENTATION
+#include "../pico_log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+static volatile bool running = true;
+
+// Dispatches queued log entries until asked to stop
+static void* log_thread(void* arg)
+{
+    (void)arg;
+
+    while (running)
+    {
+        if (0 == log_drain())
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+// Logs a batch of messages from a worker thread
+static void* worker_thread(void* arg)
+{
+    int worker = *(int*)arg;
+
+    // Attached to every entry logged by this thread
+    log_set_context("worker", worker);
+
+    for (int i = 0; i < 100; i++)
+    {
+        log_info("Message %d", i);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    log_appender_t id = log_add_stream(stdout, LOG_LEVEL_INFO);
+
+    log_display_timestamp(id, true);
+    log_display_function(id, true);
+    log_display_context(id, true);
+
+    // Wait for the queue to empty rather than dropping messages
+    log_enable_async(LOG_ASYNC_BLOCK);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, log_thread, NULL);
+
+    pthread_t workers[4];
+    int ids[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        ids[i] = i;
+        pthread_create(&workers[i], NULL, worker_thread, &ids[i]);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Stop the consumer, then dispatch anything left in the queue
+    running = false;
+    pthread_join(consumer, NULL);
+
+    log_disable_async();
+
+    printf("Dropped: %zu\n", log_dropped_count());
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#define PICO_LOG_IMPLEMENTATION
+#include "../pico_log.h"
+
+#include <stdio.h>
+
+static unsigned char buffer[4096];
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    log_appender_t id = log_add_stream(stdout, LOG_LEVEL_TRACE);
+
+    log_set_level(id, LOG_LEVEL_TRACE);
+    log_display_timestamp(id, true);
+
+    // Records are stored in binary form until the buffer is flushed
+    log_set_deferred_buffer(buffer, sizeof(buffer));
+
+    for (int i = 0; i < 10; i++)
+    {
+        log_deferred(LOG_LEVEL_TRACE, "Iteration: %d, value: %.3f, name: %s",
+                     i, i * 0.25, "example");
+    }
+
+    printf("================== Flush ==================\n");
+
+    log_flush_deferred();
+
+    printf("================== Swap buffers ==================\n");
+
+    log_deferred(LOG_LEVEL_INFO, "Recorded before the swap");
+
+    // Detach the buffer and decode its contents (this could happen on another
+    // thread)
+    size_t used = log_set_deferred_buffer(NULL, 0);
+    log_decode_deferred(buffer, used);
+
+    // Without a buffer messages are written immediately
+    log_deferred(LOG_LEVEL_INFO, "Written immediately");
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#define PICO_LOG_IMPLEMENTATION
+#include "../pico_log.h"
+
+#include <stdio.h>
+
+static char buffer[16 * 1024];
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    log_file_config_t config =
+    {
+        .buffer          = buffer,
+        .buffer_size     = sizeof(buffer),
+        .flush_interval  = 1000,      // Flush entries older than one second
+        .max_file_size   = 64 * 1024, // Rotate files at 64 KiB
+        .rotate_interval = 0,         // Never rotate by age
+        .max_backups     = 3          // Keep example6.log.1 to example6.log.3
+    };
+
+    log_appender_t id = log_add_file("example6.log", LOG_LEVEL_INFO, &config);
+
+    if (id < 0)
+    {
+        printf("Failed to open example6.log\n");
+        return 1;
+    }
+
+    log_display_timestamp(id, true);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        log_info("Test message: %d", i);
+    }
+
+    // Write whatever is left in the buffer
+    log_flush();
+
+    printf("Wrote example6.log\n");
+
+    return 0;
+}
@@ -11,6 +11,7 @@
     - Written in ANSI C
     - Single header library for easy build system integration
     - No dyanmic memory allocation
+    - SIMD fast paths (SSSE3, AVX2, NEON) selected at runtime
     - Simple and concise API
     - Permissive license (MIT)
 
@@ -40,6 +41,39 @@
     > #include "pico_b64.h"
 
     to a source file (once), then simply include the header normally.
+
+    Large buffers are encoded and decoded in blocks using SSSE3 or AVX2 on x86
+    and NEON on AArch64. The best kernel supported by the CPU is selected at
+    runtime, and the remaining bytes are handled by the portable scalar code.
+    Defining PICO_B64_NO_SIMD before including the implementation removes the
+    SIMD code entirely.
+
+    Streams that do not fit in memory can be encoded/decoded in chunks of any
+    size using `b64_encoder_t` and `b64_decoder_t`. Each call to `update`
+    carries the bytes (or characters) that do not form a complete group over
+    to the next call, and `finish` flushes them along with any padding.
+
+    The `_ex` functions and the incremental encoder/decoder accept flags that
+    select the URL-safe alphabet (`B64_URL`), omit padding (`B64_NO_PAD`), or
+    wrap lines at 76 columns (`B64_MIME`). The decoder normally stops at the
+    first invalid character, and `B64_STRICT` additionally reports its offset.
+    All variants use the same table and SIMD code paths.
+
+    Very large buffers can be split across threads using `b64_encode_parallel`
+    and `b64_decode_parallel`. The input is cut into chunks on group boundaries
+    (and line boundaries in MIME mode) and each thread writes directly into its
+    part of the destination. Threads use pthreads on POSIX systems and the
+    Win32 API on Windows, so POSIX builds may need to link with `-pthread`.
+    Defining PICO_B64_NO_THREADS makes these functions run on the calling
+    thread only.
+
+    Constants:
+    --------
+
+    - PICO_B64_MAX_THREADS (default: 64)
+    - PICO_B64_MIN_CHUNK (default: 65536, minimum bytes per thread)
+
+    Must be defined before PICO_B64_IMPLEMENTATION
 */
 
 #ifndef PICO_B64_H
@@ -51,6 +85,51 @@
 extern "C" {
 #endif
 
+/**
+ * @brief SIMD instruction sets used to accelerate encoding/decoding
+ */
+typedef enum
+{
+    B64_SIMD_NONE,
+    B64_SIMD_SSSE3,
+    B64_SIMD_AVX2,
+    B64_SIMD_NEON
+} b64_simd_t;
+
+/**
+ * @brief Encoding variants. Flags can be combined (e.g. `B64_URL | B64_NO_PAD`)
+ */
+typedef enum
+{
+    B64_STANDARD = 0,      //!< Standard alphabet with padding (RFC 4648)
+    B64_URL      = 1 << 0, //!< URL and filename safe alphabet ('-' and '_')
+    B64_NO_PAD   = 1 << 1, //!< Omits padding ('=' is rejected when decoding)
+    B64_MIME     = 1 << 2, //!< Lines of 76 characters separated by CRLF.
+                           //!< Whitespace is skipped when decoding
+    B64_STRICT   = 1 << 3  //!< Reports the first invalid character when decoding
+} b64_flags_t;
+
+/**
+ * @brief Returned by the decoder when no invalid character was found
+ */
+#define B64_NO_ERROR ((size_t)-1)
+
+/**
+ * @brief Returns the instruction set used by the encoder/decoder. The CPU is
+ * queried on the first call
+ */
+b64_simd_t b64_get_simd(void);
+
+/**
+ * @brief Limits the instruction set used by the encoder/decoder (e.g.
+ * `B64_SIMD_NONE` forces the scalar code). Levels higher than what the CPU
+ * supports are clamped to the best supported level. Instruction sets of other
+ * architectures select the scalar code
+ *
+ * @param simd The maximum instruction set to use
+ */
+void b64_set_simd(b64_simd_t simd);
+
 /**
  * @brief Returns the Base64 encoded size of an array of bytes (NOTE: This does
  * not include a null terminator)
@@ -69,6 +148,15 @@ size_t b64_encoded_size(size_t len);
  */
 size_t b64_decoded_size(const char* src, size_t len);
 
+/**
+ * @brief Returns the size of an array of bytes encoded using a variant (NOTE:
+ * This does not include a null terminator)
+ *
+ * @param len The length of the array of bytes
+ * @param flags The encoding variant (see `b64_flags_t`)
+ */
+size_t b64_encoded_size_ex(size_t len, int flags);
+
 /**
  * @brief Encodes an array of bytes into a Base64 encoded string (NOTE: A null
  * terminator is not appended)
@@ -91,6 +179,179 @@ size_t b64_encode(char* dst, const unsigned char* src, size_t len);
  */
 size_t b64_decode(unsigned char* dst, const char* src, size_t len);
 
+/**
+ * @brief Encodes an array of bytes using a variant (NOTE: A null terminator is
+ * not appended)
+ *
+ * @param dst Encoded character (destination) buffer. Must hold at least
+ * `b64_encoded_size_ex(len, flags)` characters
+ * @param src Byte array to be encoded
+ * @param len Length of `src` in bytes
+ * @param flags The encoding variant (see `b64_flags_t`)
+ * @returns Number of encoded characters
+ */
+size_t b64_encode_ex(char* dst, const unsigned char* src, size_t len, int flags);
+
+/**
+ * @brief Decodes a string encoded using a variant (NOTE: A null terminator is
+ * not appended). Unpadded input is always accepted unless `B64_STRICT` is set
+ *
+ * Decoding stops at the first character that is not part of the variant. In
+ * strict mode, misplaced or missing padding and truncated input also count as
+ * invalid
+ *
+ * @param dst Decoded byte array (destination). Must hold at least
+ * `(len + 3) / 4 * 3` bytes
+ * @param src Character array to be decoded
+ * @param len Length of `src` in bytes
+ * @param flags The encoding variant (see `b64_flags_t`)
+ * @param error If not NULL and `B64_STRICT` is set, receives the offset of the
+ * first invalid character (`len` if the input is truncated), or `B64_NO_ERROR`
+ * @returns Number of bytes decoded before the first invalid character
+ */
+size_t b64_decode_ex(unsigned char* dst,
+                     const char* src,
+                     size_t len,
+                     int flags,
+                     size_t* error);
+
+/**
+ * @brief Encodes an array of bytes on multiple threads. The result is
+ * identical to `b64_encode_ex`
+ *
+ * @param dst Encoded character (destination) buffer. Must hold at least
+ * `b64_encoded_size_ex(len, flags)` characters
+ * @param src Byte array to be encoded
+ * @param len Length of `src` in bytes
+ * @param flags The encoding variant (see `b64_flags_t`)
+ * @param threads Maximum number of threads to use (including the caller)
+ * @returns Number of encoded characters
+ */
+size_t b64_encode_parallel(char* dst,
+                           const unsigned char* src,
+                           size_t len,
+                           int flags,
+                           int threads);
+
+/**
+ * @brief Decodes a string on multiple threads. The result is identical to
+ * `b64_decode_ex`. Input with `B64_MIME` set is decoded on the calling thread,
+ * since line breaks make the output offsets unknown in advance
+ *
+ * @param dst Decoded byte array (destination). Must hold at least
+ * `(len + 3) / 4 * 3` bytes
+ * @param src Character array to be decoded
+ * @param len Length of `src` in bytes
+ * @param flags The encoding variant (see `b64_flags_t`)
+ * @param error See `b64_decode_ex`
+ * @param threads Maximum number of threads to use (including the caller)
+ * @returns Number of bytes decoded before the first invalid character
+ */
+size_t b64_decode_parallel(unsigned char* dst,
+                           const char* src,
+                           size_t len,
+                           int flags,
+                           size_t* error,
+                           int threads);
+
+/**
+ * @brief Incremental encoder state. Holds up to two bytes that did not form a
+ * complete group in the previous call
+ */
+typedef struct
+{
+    unsigned char buf[3];
+    int count;
+    int flags;
+    int column;
+} b64_encoder_t;
+
+/**
+ * @brief Incremental decoder state. Holds up to three characters that did not
+ * form a complete group in the previous call
+ */
+typedef struct
+{
+    unsigned char buf[4];
+    int count;
+    int padding;
+    int done;
+    int flags;
+    size_t offset;
+    size_t error; //!< Offset of the first invalid character in strict mode
+} b64_decoder_t;
+
+/**
+ * @brief Initializes (or resets) an incremental encoder
+ *
+ * @param encoder The encoder state
+ * @param flags The encoding variant (see `b64_flags_t`)
+ */
+void b64_encoder_init(b64_encoder_t* encoder, int flags);
+
+/**
+ * @brief Encodes the next chunk of a byte stream
+ *
+ * @param encoder The encoder state
+ * @param dst Encoded character (destination) buffer. Must hold at least
+ * `b64_encoded_size(len)` characters, or `b64_encoded_size_ex(len, B64_MIME) + 2`
+ * in MIME mode
+ * @param src Next chunk of bytes to be encoded
+ * @param len Length of `src` in bytes
+ * @returns Number of encoded characters
+ */
+size_t b64_encoder_update(b64_encoder_t* encoder,
+                          char* dst,
+                          const unsigned char* src,
+                          size_t len);
+
+/**
+ * @brief Encodes the remaining bytes (with padding unless `B64_NO_PAD` is set)
+ * and resets the encoder
+ *
+ * @param encoder The encoder state
+ * @param dst Encoded character (destination) buffer. Must hold at least six
+ * characters
+ * @returns Number of encoded characters
+ */
+size_t b64_encoder_finish(b64_encoder_t* encoder, char* dst);
+
+/**
+ * @brief Initializes (or resets) an incremental decoder
+ *
+ * @param decoder The decoder state
+ * @param flags The encoding variant (see `b64_flags_t`)
+ */
+void b64_decoder_init(b64_decoder_t* decoder, int flags);
+
+/**
+ * @brief Decodes the next chunk of a Base64 encoded stream. As with
+ * `b64_decode_ex`, decoding stops at the first invalid character, and any
+ * input after that is ignored
+ *
+ * @param decoder The decoder state
+ * @param dst Decoded byte array (destination). Must hold at least
+ * `(len + 3) / 4 * 3` bytes
+ * @param src Next chunk of characters to be decoded
+ * @param len Length of `src` in bytes
+ * @returns Number of decoded bytes
+ */
+size_t b64_decoder_update(b64_decoder_t* decoder,
+                          unsigned char* dst,
+                          const char* src,
+                          size_t len);
+
+/**
+ * @brief Decodes the remaining characters. In strict mode, `error` is set if
+ * the stream is truncated. The decoder must be initialized again before it is
+ * reused
+ *
+ * @param decoder The decoder state
+ * @param dst Decoded byte array (destination). Must hold at least two bytes
+ * @returns Number of decoded bytes
+ */
+size_t b64_decoder_finish(b64_decoder_t* decoder, unsigned char* dst);
+
 #ifdef __cplusplus
 }
 #endif
@@ -99,10 +360,51 @@ size_t b64_decode(unsigned char* dst, const char* src, size_t len);
 
 #ifdef PICO_B64_IMPLEMENTATION
 
-#include <ctype.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef PICO_B64_NO_SIMD
+    #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        #define B64_X86
+        #include <immintrin.h>
+        #ifdef _MSC_VER
+            #include <intrin.h>
+        #endif
+    #elif defined(__aarch64__) || defined(_M_ARM64)
+        #define B64_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+#ifndef PICO_B64_NO_THREADS
+    #if defined(_WIN32)
+        #define B64_WIN32_THREADS
+        #include <windows.h>
+    #elif defined(__unix__) || defined(__APPLE__)
+        #define B64_POSIX_THREADS
+        #include <pthread.h>
+    #endif
+#endif
+
+#ifndef PICO_B64_MAX_THREADS
+#define PICO_B64_MAX_THREADS 64
+#endif
+
+#ifndef PICO_B64_MIN_CHUNK
+#define PICO_B64_MIN_CHUNK 65536
+#endif
+
+// Maximum line length in MIME mode (RFC 2045)
+#define B64_MIME_LINE_LEN 76
+
+// Allows the x86 kernels to be compiled without -mssse3/-mavx2. They are only
+// called if the CPU supports them
+#if defined(B64_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define B64_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define B64_TARGET(isa)
+#endif
 
 /*=============================================================================
  * Look-up table
@@ -120,13 +422,82 @@ static const char b64_table[] =
   '4', '5', '6', '7', '8', '9', '+', '/'
 };
 
+static const char b64_url_table[] =
+{
+  'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+  'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+  'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+  'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+  'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+  'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+  'w', 'x', 'y', 'z', '0', '1', '2', '3',
+  '4', '5', '6', '7', '8', '9', '-', '_'
+};
+
+// Maps characters back to 6-bit values. Characters outside of the alphabet
+// (including padding) map to 0xff
+static const unsigned char b64_reverse_table[256] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static const unsigned char b64_url_reverse_table[256] =
+{
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
 /*=============================================================================
  * Buffer size functions
  *============================================================================*/
 
 size_t b64_encoded_size(size_t len)
 {
-    return 4 * ceil(len / 3.0);
+    return len / 3 * 4 + (len % 3 ? 4 : 0);
+}
+
+size_t b64_encoded_size_ex(size_t len, int flags)
+{
+    size_t size = b64_encoded_size(len);
+
+    // Drop the padding
+    if ((flags & B64_NO_PAD) && len % 3)
+        size -= 3 - len % 3;
+
+    // CRLF between lines
+    if ((flags & B64_MIME) && size > 0)
+        size += (size - 1) / B64_MIME_LINE_LEN * 2;
+
+    return size;
 }
 
 size_t b64_decoded_size(const char* src, size_t len)
@@ -145,7 +516,7 @@ size_t b64_decoded_size(const char* src, size_t len)
     else if ('=' == src[len - 1])
         padding = 1;
 
-    return floor(3.0 * (len - padding) / 4.0);
+    return len / 4 * 3 - padding;
 }
 
 /*=============================================================================
@@ -167,151 +538,1226 @@ static inline void b64_decode_tmp(unsigned char* buf, unsigned char* tmp)
 }
 
 /*=============================================================================
- * Encoding
+ * SIMD kernels
  *============================================================================*/
 
-size_t b64_encode(char* dst, const unsigned char* src, size_t len)
+/*
+ * Each kernel processes as many whole blocks as it can and returns the number
+ * of source bytes consumed. The scalar code finishes the remainder.
+ *
+ * Decoding kernels stop at the first block containing a character outside of
+ * the alphabet (including padding and whitespace), so the scalar code handles
+ * padding, line breaks and invalid input.
+ */
+
+#ifdef B64_X86
+
+/*
+ * x86 kernels (W. Mula, D. Lemire, "Faster Base64 Encoding and Decoding Using
+ * AVX2 Instructions", 2018)
+ */
+
+// Moves each 6-bit group (spread over 4 bytes by the shuffle) into its own byte
+B64_TARGET("ssse3")
+static inline __m128i b64_unpack_ssse3(__m128i in)
 {
-    int i = 0;
-    int j = 0;
-    size_t size = 0;
-    unsigned char buf[4];
-    unsigned char tmp[3];
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
 
-    // Parse until end of source
-    while (len--)
-    {
-        // Read up to 3 bytes at a time into 'tmp'
-        tmp[i++] = *(src++);
+// Offsets from 6-bit values to ASCII, indexed by range. Only the last two
+// characters differ between alphabets
+B64_TARGET("ssse3")
+static inline __m128i b64_offsets_ssse3(const char* table)
+{
+    return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                         '0' - 52, table[62] - 62, table[63] - 63, 'A', 0, 0);
+}
 
-        // If 3 bytes read then encode them
-        if (3 == i)
-        {
-            b64_encode_tmp(buf, tmp);
+// Maps 6-bit values to ASCII by adding an offset that depends on the range
+B64_TARGET("ssse3")
+static inline __m128i b64_translate_ssse3(__m128i in, __m128i offsets)
+{
+    __m128i index = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i less  = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
 
-            // Translate buffer
-            for (i = 0; i < 4; ++i)
-            {
-                dst[size++] = b64_table[buf[i]];
-            }
+    index = _mm_or_si128(index, _mm_and_si128(less, _mm_set1_epi8(13)));
 
-            // reset index
-            i = 0;
-        }
-    }
+    return _mm_add_epi8(in, _mm_shuffle_epi8(offsets, index));
+}
 
-    // Remainder
-    if (i > 0)
-    {
-        // Fill 'tmp' with '\0' at most twice
-        for (j = i; j < 3; ++j)
-        {
-            tmp[j] = '\0';
-        }
+// Maps ASCII to 6-bit values. Sets 'valid' to zero if any byte is invalid
+B64_TARGET("ssse3")
+static inline __m128i b64_lookup_ssse3(__m128i in, int url, int* valid)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                         0x1b, 0x1b, 0x1b, 0x1a);
 
-        // Perform same transformation as above
-        b64_encode_tmp(buf, tmp);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                         0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
 
-        // Translate buffer
-        for (j = 0; j < i + 1; ++j)
-        {
-            dst[size++] = b64_table[buf[j]];
-        }
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
 
-        // While there is still a remainder append '=' to 'dst'
-        while (i++ < 3)
-        {
-            dst[size++] = '=';
-        }
+    const __m128i mask = _mm_set1_epi8(0x0f);
+
+    __m128i reject = _mm_setzero_si128();
+
+    // Map '-' and '_' onto '+' and '/', and reject '+' and '/'
+    if (url)
+    {
+        __m128i dash = _mm_cmpeq_epi8(in, _mm_set1_epi8('-'));
+        __m128i underscore = _mm_cmpeq_epi8(in, _mm_set1_epi8('_'));
+
+        reject = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('+')),
+                              _mm_cmpeq_epi8(in, _mm_set1_epi8('/')));
+
+        in = _mm_sub_epi8(in, _mm_and_si128(dash, _mm_set1_epi8('-' - '+')));
+        in = _mm_sub_epi8(in, _mm_and_si128(underscore, _mm_set1_epi8('_' - '/')));
     }
 
-    return size;
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+    __m128i lo = _mm_and_si128(in, mask);
+
+    __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                                _mm_shuffle_epi8(lut_hi, hi));
+
+    bad = _mm_or_si128(_mm_cmpgt_epi8(bad, _mm_setzero_si128()), reject);
+
+    *valid = 0 == _mm_movemask_epi8(bad);
+
+    __m128i eq_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi));
+
+    return _mm_add_epi8(in, roll);
 }
 
-/*=============================================================================
- * Decoding
- *============================================================================*/
+// Packs four 6-bit values into three bytes (12 bytes in the low lanes)
+B64_TARGET("ssse3")
+static inline __m128i b64_pack_ssse3(__m128i in)
+{
+    __m128i merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+    return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                                  14, 13, 12, -1, -1, -1, -1));
+}
 
-static inline size_t b64_table_lookup(char symbol)
+B64_TARGET("ssse3")
+static size_t b64_encode_ssse3(char* dst,
+                               const unsigned char* src,
+                               size_t len,
+                               const char* table)
 {
-    size_t i;
+    const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                         4, 5, 3, 4, 1, 2, 0, 1);
+
+    const __m128i offsets = b64_offsets_ssse3(table);
 
-    for (i = 0; i < 64; ++i)
+    size_t n = 0;
+
+    // Loads 16 bytes, but only the first 12 are encoded
+    while (len - n >= 16)
     {
-        if (symbol == b64_table[i])
-            return i;
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + n));
+
+        in = b64_unpack_ssse3(_mm_shuffle_epi8(in, shuffle));
+
+        _mm_storeu_si128((__m128i*)dst, b64_translate_ssse3(in, offsets));
+
+        dst += 16;
+        n += 12;
     }
 
-    return 0;
+    return n;
 }
 
-size_t b64_decode(unsigned char* dst, const char * src, size_t len)
+B64_TARGET("ssse3")
+static size_t b64_decode_ssse3(unsigned char* dst,
+                               const char* src,
+                               size_t len,
+                               int url)
 {
-    int i = 0;
-    int j = 0;
-    size_t size = 0;
-    unsigned char buf[3];
-    unsigned char tmp[4];
+    size_t n = 0;
+    int valid;
 
-    // Parse until end of source
-    while (len--) {
-        // Break if char is padding ('=') or not base64 char
-        if ('=' == src[j])
-            break;
+    while (len - n >= 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + n));
 
-        // Break if char is not base64
-        if (!isalnum((int)src[j]) && '+' != src[j] && '/' != src[j])
+        in = b64_lookup_ssse3(in, url, &valid);
+
+        if (!valid)
             break;
 
-        // Read up to 4 bytes at a time into 'tmp'
-        tmp[i++] = src[j++];
+        in = b64_pack_ssse3(in);
 
-        // If 4 bytes read then decode into 'buf'
-        if (4 == i)
-        {
-            // Translate values in 'tmp' from table
-            for (i = 0; i < 4; ++i)
-            {
-                tmp[i] = b64_table_lookup(tmp[i]);
-            }
+        // Store exactly 12 bytes
+        _mm_storel_epi64((__m128i*)dst, in);
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(in, 8));
+        memcpy(dst + 8, &tail, 4);
 
-            // Decode transform
-            b64_decode_tmp(buf, tmp);
+        dst += 12;
+        n += 16;
+    }
 
-            // Write into result
-            for (i = 0; i < 3; ++i)
-            {
-                dst[size++] = buf[i];
-            }
+    return n;
+}
 
-            // Reset
-            i = 0;
-        }
+B64_TARGET("avx2")
+static size_t b64_encode_avx2(char* dst,
+                              const unsigned char* src,
+                              size_t len,
+                              const char* table)
+{
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                            4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7,
+                                            4, 5, 3, 4, 1, 2, 0, 1);
+
+    const __m256i offsets = _mm256_broadcastsi128_si256(b64_offsets_ssse3(table));
+    size_t n = 0;
+
+    // Each lane loads 16 bytes and encodes the first 12
+    while (len - n >= 32)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + n));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + n + 12));
+
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        in = _mm256_shuffle_epi8(in, shuffle);
+
+        // Unpack
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+
+        in = _mm256_or_si256(t1, t3);
+
+        // Translate
+        __m256i index = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+        __m256i less  = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), in);
+
+        index = _mm256_or_si256(index, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        in = _mm256_add_epi8(in, _mm256_shuffle_epi8(offsets, index));
+
+        _mm256_storeu_si256((__m256i*)dst, in);
+
+        dst += 32;
+        n += 24;
     }
 
-    // Remainder
-    if (i > 0)
+    return n;
+}
+
+B64_TARGET("avx2")
+static size_t b64_decode_avx2(unsigned char* dst,
+                              const char* src,
+                              size_t len,
+                              int url)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a);
+
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                            0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                            0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10);
+
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                          14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                          14, 13, 12, -1, -1, -1, -1);
+
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+
+    size_t n = 0;
+
+    while (len - n >= 32)
     {
-        // Fill 'tmp' with '\0' at most 3 times
-        for (j = i; j < 4; ++j)
-        {
-            tmp[j] = '\0';
-        }
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + n));
 
-        // Translate remainder
-        for (j = 0; j < 4; ++j)
+        __m256i reject = _mm256_setzero_si256();
+
+        // Map '-' and '_' onto '+' and '/', and reject '+' and '/'
+        if (url)
         {
-            // find translation char in 'b64_table'
-            tmp[j] = b64_table_lookup(tmp[j]);
+            __m256i dash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('-'));
+            __m256i underscore = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('_'));
+
+            reject = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('+')),
+                                     _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')));
+
+            in = _mm256_sub_epi8(in, _mm256_and_si256(dash, _mm256_set1_epi8('-' - '+')));
+            in = _mm256_sub_epi8(in, _mm256_and_si256(underscore, _mm256_set1_epi8('_' - '/')));
         }
 
-        // Decode transform
-        b64_decode_tmp(buf, tmp);
+        // Lookup and validate
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+        __m256i lo = _mm256_and_si256(in, mask);
 
-        // Write into result
-        for (j = 0; j < i - 1; ++j)
-        {
-            dst[size++] = buf[j];
+        __m256i bad = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+                                       _mm256_shuffle_epi8(lut_hi, hi));
+
+        bad = _mm256_or_si256(_mm256_cmpgt_epi8(bad, _mm256_setzero_si256()), reject);
+
+        if (_mm256_movemask_epi8(bad))
+            break;
+
+        __m256i eq_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_slash, hi));
+
+        in = _mm256_add_epi8(in, roll);
+
+        // Pack 12 bytes per lane and move them next to each other
+        in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+        in = _mm256_shuffle_epi8(in, pack);
+        in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+        // Store exactly 24 bytes
+        _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(in));
+        _mm_storel_epi64((__m128i*)(dst + 16), _mm256_extracti128_si256(in, 1));
+
+        dst += 24;
+        n += 32;
+    }
+
+    return n;
+}
+
+#endif // B64_X86
+
+#ifdef B64_NEON
+
+// Maps ASCII to 6-bit values. Invalid characters set bits in 'bad'
+static inline uint8x16_t b64_lookup_neon(uint8x16_t in, int url, uint8x16_t* bad)
+{
+    static const uint8_t lut_lo[16] =
+    {
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+    };
+
+    static const uint8_t lut_hi[16] =
+    {
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+    };
+
+    static const uint8_t lut_roll[16] =
+    {
+        0, 16, 19, 4, (uint8_t)-65, (uint8_t)-65, (uint8_t)-71, (uint8_t)-71,
+        0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    // Map '-' and '_' onto '+' and '/', and reject '+' and '/'
+    if (url)
+    {
+        uint8x16_t dash = vceqq_u8(in, vdupq_n_u8('-'));
+        uint8x16_t underscore = vceqq_u8(in, vdupq_n_u8('_'));
+
+        *bad = vorrq_u8(*bad, vorrq_u8(vceqq_u8(in, vdupq_n_u8('+')),
+                                       vceqq_u8(in, vdupq_n_u8('/'))));
+
+        in = vsubq_u8(in, vandq_u8(dash, vdupq_n_u8('-' - '+')));
+        in = vsubq_u8(in, vandq_u8(underscore, vdupq_n_u8('_' - '/')));
+    }
+
+    uint8x16_t hi = vshrq_n_u8(in, 4);
+    uint8x16_t lo = vandq_u8(in, vdupq_n_u8(0x0f));
+
+    *bad = vorrq_u8(*bad, vandq_u8(vqtbl1q_u8(vld1q_u8(lut_lo), lo),
+                                   vqtbl1q_u8(vld1q_u8(lut_hi), hi)));
+
+    uint8x16_t eq_slash = vceqq_u8(in, vdupq_n_u8('/'));
+    uint8x16_t roll = vqtbl1q_u8(vld1q_u8(lut_roll), vaddq_u8(eq_slash, hi));
+
+    return vaddq_u8(in, roll);
+}
+
+static size_t b64_encode_neon(char* dst,
+                              const unsigned char* src,
+                              size_t len,
+                              const char* table)
+{
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+
+    uint8x16x4_t lut;
+    lut.val[0] = vld1q_u8((const uint8_t*)table);
+    lut.val[1] = vld1q_u8((const uint8_t*)table + 16);
+    lut.val[2] = vld1q_u8((const uint8_t*)table + 32);
+    lut.val[3] = vld1q_u8((const uint8_t*)table + 48);
+
+    size_t n = 0;
+
+    while (len - n >= 48)
+    {
+        // Deinterleave into three vectors of 16 bytes
+        uint8x16x3_t in = vld3q_u8(src + n);
+        uint8x16x4_t out;
+
+        out.val[0] = vshrq_n_u8(in.val[0], 2);
+        out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                       vshrq_n_u8(in.val[1], 4)), mask);
+        out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                       vshrq_n_u8(in.val[2], 6)), mask);
+        out.val[3] = vandq_u8(in.val[2], mask);
+
+        out.val[0] = vqtbl4q_u8(lut, out.val[0]);
+        out.val[1] = vqtbl4q_u8(lut, out.val[1]);
+        out.val[2] = vqtbl4q_u8(lut, out.val[2]);
+        out.val[3] = vqtbl4q_u8(lut, out.val[3]);
+
+        vst4q_u8((uint8_t*)dst, out);
+
+        dst += 64;
+        n += 48;
+    }
+
+    return n;
+}
+
+static size_t b64_decode_neon(unsigned char* dst,
+                              const char* src,
+                              size_t len,
+                              int url)
+{
+    size_t n = 0;
+
+    while (len - n >= 64)
+    {
+        // Deinterleave into four vectors of 16 characters
+        uint8x16x4_t in = vld4q_u8((const uint8_t*)src + n);
+        uint8x16x3_t out;
+        uint8x16_t bad = vdupq_n_u8(0);
+
+        in.val[0] = b64_lookup_neon(in.val[0], url, &bad);
+        in.val[1] = b64_lookup_neon(in.val[1], url, &bad);
+        in.val[2] = b64_lookup_neon(in.val[2], url, &bad);
+        in.val[3] = b64_lookup_neon(in.val[3], url, &bad);
+
+        if (vmaxvq_u8(bad))
+            break;
+
+        out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+
+        vst3q_u8(dst, out);
+
+        dst += 48;
+        n += 64;
+    }
+
+    return n;
+}
+
+#endif // B64_NEON
+
+/*=============================================================================
+ * SIMD dispatch
+ *============================================================================*/
+
+// -1 until the CPU has been queried
+static int b64_simd = -1;
+
+static b64_simd_t b64_detect_simd(void)
+{
+#if defined(B64_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return B64_SIMD_AVX2;
+
+    if (__builtin_cpu_supports("ssse3"))
+        return B64_SIMD_SSSE3;
+
+#elif defined(B64_X86) && defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 0);
+
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+
+    int ssse3 = (info[2] >> 9) & 1;
+    int avx   = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1);
+
+    // AVX2 also requires the OS to save the YMM registers
+    if (max_leaf >= 7 && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+
+        if ((info[1] >> 5) & 1)
+            return B64_SIMD_AVX2;
+    }
+
+    if (ssse3)
+        return B64_SIMD_SSSE3;
+
+#elif defined(B64_NEON)
+    return B64_SIMD_NEON;
+#endif
+
+    return B64_SIMD_NONE;
+}
+
+b64_simd_t b64_get_simd(void)
+{
+    if (b64_simd < 0)
+        b64_simd = b64_detect_simd();
+
+    return (b64_simd_t)b64_simd;
+}
+
+void b64_set_simd(b64_simd_t simd)
+{
+    b64_simd_t best = b64_detect_simd();
+
+    switch (simd)
+    {
+#ifdef B64_X86
+        // AVX2 support implies SSSE3 support
+        case B64_SIMD_AVX2:
+        case B64_SIMD_SSSE3:
+            b64_simd = (simd < best) ? simd : best;
+            break;
+#endif
+
+#ifdef B64_NEON
+        case B64_SIMD_NEON:
+            b64_simd = best;
+            break;
+#endif
+
+        // Not compiled for this architecture
+        default:
+            b64_simd = B64_SIMD_NONE;
+            break;
+    }
+}
+
+static size_t b64_encode_blocks(char* dst,
+                                const unsigned char* src,
+                                size_t len,
+                                const char* table)
+{
+    switch (b64_get_simd())
+    {
+#ifdef B64_X86
+        case B64_SIMD_AVX2:
+        {
+            size_t n = b64_encode_avx2(dst, src, len, table);
+            return n + b64_encode_ssse3(dst + n / 3 * 4, src + n, len - n, table);
+        }
+
+        case B64_SIMD_SSSE3:
+            return b64_encode_ssse3(dst, src, len, table);
+#endif
+
+#ifdef B64_NEON
+        case B64_SIMD_NEON:
+            return b64_encode_neon(dst, src, len, table);
+#endif
+
+        default:
+            (void)dst; (void)src; (void)len; (void)table;
+            return 0;
+    }
+}
+
+static size_t b64_decode_blocks(unsigned char* dst,
+                                const char* src,
+                                size_t len,
+                                int url)
+{
+    switch (b64_get_simd())
+    {
+#ifdef B64_X86
+        case B64_SIMD_AVX2:
+        {
+            size_t n = b64_decode_avx2(dst, src, len, url);
+            return n + b64_decode_ssse3(dst + n / 4 * 3, src + n, len - n, url);
+        }
+
+        case B64_SIMD_SSSE3:
+            return b64_decode_ssse3(dst, src, len, url);
+#endif
+
+#ifdef B64_NEON
+        case B64_SIMD_NEON:
+            return b64_decode_neon(dst, src, len, url);
+#endif
+
+        default:
+            (void)dst; (void)src; (void)len; (void)url;
+            return 0;
+    }
+}
+
+/*=============================================================================
+ * Encoding
+ *============================================================================*/
+
+// Encodes whole groups of 3 bytes ('len' must be a multiple of 3)
+static size_t b64_encode_groups(char* dst,
+                                const unsigned char* src,
+                                size_t len,
+                                const char* table)
+{
+    // Encode whole blocks with SIMD if available
+    size_t i = b64_encode_blocks(dst, src, len, table);
+    size_t size = i / 3 * 4;
+
+    // Encode 3 bytes at a time
+    for (; i < len; i += 3)
+    {
+        unsigned long triple = ((unsigned long)src[i] << 16) |
+                               ((unsigned long)src[i + 1] << 8) | src[i + 2];
+
+        dst[size + 0] = table[(triple >> 18) & 0x3f];
+        dst[size + 1] = table[(triple >> 12) & 0x3f];
+        dst[size + 2] = table[(triple >> 6) & 0x3f];
+        dst[size + 3] = table[triple & 0x3f];
+
+        size += 4;
+    }
+
+    return size;
+}
+
+// Encodes a final group of 1 or 2 bytes, followed by padding if requested
+static size_t b64_encode_tail(char* dst,
+                              const unsigned char* src,
+                              size_t len,
+                              const char* table,
+                              int pad)
+{
+    unsigned char tmp[3] = { 0 };
+    unsigned char buf[4];
+    size_t i, size = 0;
+
+    memcpy(tmp, src, len);
+
+    b64_encode_tmp(buf, tmp);
+
+    // Translate buffer
+    for (i = 0; i < len + 1; ++i)
+    {
+        dst[size++] = table[buf[i]];
+    }
+
+    // Append '=' until the group is complete
+    while (pad && size < 4)
+    {
+        dst[size++] = '=';
+    }
+
+    return size;
+}
+
+// Encodes whole groups, inserting line breaks in MIME mode
+static size_t b64_encoder_put(b64_encoder_t* encoder,
+                              char* dst,
+                              const unsigned char* src,
+                              size_t len)
+{
+    const char* table = (encoder->flags & B64_URL) ? b64_url_table : b64_table;
+    size_t size = 0;
+
+    if (!(encoder->flags & B64_MIME))
+        return b64_encode_groups(dst, src, len, table);
+
+    while (len > 0)
+    {
+        // Break the line before it grows past the limit
+        if (B64_MIME_LINE_LEN == encoder->column)
+        {
+            dst[size++] = '\r';
+            dst[size++] = '\n';
+            encoder->column = 0;
+        }
+
+        // Encode as many groups as fit on the current line
+        size_t n = (B64_MIME_LINE_LEN - encoder->column) / 4 * 3;
+
+        if (n > len)
+            n = len;
+
+        size += b64_encode_groups(dst + size, src, n, table);
+
+        encoder->column += (int)(n / 3 * 4);
+        src += n;
+        len -= n;
+    }
+
+    return size;
+}
+
+size_t b64_encode(char* dst, const unsigned char* src, size_t len)
+{
+    return b64_encode_ex(dst, src, len, B64_STANDARD);
+}
+
+size_t b64_encode_ex(char* dst, const unsigned char* src, size_t len, int flags)
+{
+    b64_encoder_t encoder;
+    size_t size;
+
+    b64_encoder_init(&encoder, flags);
+    size = b64_encoder_update(&encoder, dst, src, len);
+    size += b64_encoder_finish(&encoder, dst + size);
+
+    return size;
+}
+
+/*=============================================================================
+ * Decoding
+ *============================================================================*/
+
+// Decodes whole groups of 4 characters until padding, an invalid character, or
+// fewer than 4 characters remain. Returns the number of decoded bytes and
+// stores the number of characters consumed in 'count'
+static size_t b64_decode_groups(unsigned char* dst,
+                                const char* src,
+                                size_t len,
+                                int url,
+                                size_t* count)
+{
+    const unsigned char* in = (const unsigned char*)src;
+    const unsigned char* table = url ? b64_url_reverse_table : b64_reverse_table;
+    size_t i, size;
+
+    // Decode whole blocks with SIMD if available
+    i = b64_decode_blocks(dst, src, len, url);
+    size = i / 4 * 3;
+
+    // Decode 4 characters at a time
+    while (len - i >= 4)
+    {
+        unsigned a = table[in[i + 0]];
+        unsigned b = table[in[i + 1]];
+        unsigned c = table[in[i + 2]];
+        unsigned d = table[in[i + 3]];
+
+        // Invalid characters have the high bit set
+        if ((a | b | c | d) & 0x80)
+            break;
+
+        unsigned long triple = ((unsigned long)a << 18) | (b << 12) | (c << 6) | d;
+
+        dst[size + 0] = (unsigned char)(triple >> 16);
+        dst[size + 1] = (unsigned char)(triple >> 8);
+        dst[size + 2] = (unsigned char)triple;
+
+        size += 3;
+        i += 4;
+    }
+
+    *count = i;
+
+    return size;
+}
+
+size_t b64_decode(unsigned char* dst, const char * src, size_t len)
+{
+    return b64_decode_ex(dst, src, len, B64_STANDARD, NULL);
+}
+
+size_t b64_decode_ex(unsigned char* dst,
+                     const char* src,
+                     size_t len,
+                     int flags,
+                     size_t* error)
+{
+    b64_decoder_t decoder;
+    size_t size;
+
+    // Decode into 'dst' directly, and finish off the remainder
+    b64_decoder_init(&decoder, flags);
+    size = b64_decoder_update(&decoder, dst, src, len);
+    size += b64_decoder_finish(&decoder, dst + size);
+
+    if (error)
+        *error = decoder.error;
+
+    return size;
+}
+
+/*=============================================================================
+ * Incremental encoding/decoding
+ *============================================================================*/
+
+void b64_encoder_init(b64_encoder_t* encoder, int flags)
+{
+    encoder->count = 0;
+    encoder->flags = flags;
+    encoder->column = 0;
+}
+
+size_t b64_encoder_update(b64_encoder_t* encoder,
+                          char* dst,
+                          const unsigned char* src,
+                          size_t len)
+{
+    size_t size = 0;
+
+    // Complete the group left over from the previous call
+    if (encoder->count > 0)
+    {
+        while (encoder->count < 3 && len > 0)
+        {
+            encoder->buf[encoder->count++] = *(src++);
+            len--;
+        }
+
+        if (encoder->count < 3)
+            return 0;
+
+        size = b64_encoder_put(encoder, dst, encoder->buf, 3);
+        encoder->count = 0;
+    }
+
+    // Encode whole groups (no padding is produced)
+    size_t n = len - len % 3;
+
+    size += b64_encoder_put(encoder, dst + size, src, n);
+
+    // Keep the remaining bytes for the next call
+    memcpy(encoder->buf, src + n, len - n);
+    encoder->count = (int)(len - n);
+
+    return size;
+}
+
+size_t b64_encoder_finish(b64_encoder_t* encoder, char* dst)
+{
+    const char* table = (encoder->flags & B64_URL) ? b64_url_table : b64_table;
+    size_t size = 0;
+
+    if (encoder->count > 0)
+    {
+        if ((encoder->flags & B64_MIME) && B64_MIME_LINE_LEN == encoder->column)
+        {
+            dst[size++] = '\r';
+            dst[size++] = '\n';
+        }
+
+        size += b64_encode_tail(dst + size, encoder->buf, encoder->count,
+                                table, !(encoder->flags & B64_NO_PAD));
+    }
+
+    b64_encoder_init(encoder, encoder->flags);
+
+    return size;
+}
+
+void b64_decoder_init(b64_decoder_t* decoder, int flags)
+{
+    memset(decoder->buf, 0, sizeof(decoder->buf));
+    decoder->count = 0;
+    decoder->padding = 0;
+    decoder->done = 0;
+    decoder->flags = flags;
+    decoder->offset = 0;
+    decoder->error = B64_NO_ERROR;
+}
+
+static inline int b64_is_space(unsigned char c)
+{
+    return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+// Stops decoding. In strict mode the offset of the offending character is
+// recorded
+static inline void b64_decoder_stop(b64_decoder_t* decoder, size_t offset)
+{
+    if ((decoder->flags & B64_STRICT) && B64_NO_ERROR == decoder->error)
+        decoder->error = offset;
+
+    decoder->done = 1;
+}
+
+size_t b64_decoder_update(b64_decoder_t* decoder,
+                          unsigned char* dst,
+                          const char* src,
+                          size_t len)
+{
+    const unsigned char* in = (const unsigned char*)src;
+    const int url = decoder->flags & B64_URL;
+    const int mime = decoder->flags & B64_MIME;
+    const unsigned char* table = url ? b64_url_reverse_table : b64_reverse_table;
+
+    size_t i = 0;
+    size_t size = 0;
+
+    while (i < len && !decoder->done)
+    {
+        // Decode whole groups directly from the input when possible
+        if (0 == decoder->count && 0 == decoder->padding)
+        {
+            size_t n;
+
+            size += b64_decode_groups(dst + size, src + i, len - i, url, &n);
+            i += n;
+
+            if (i == len)
+                break;
+        }
+
+        unsigned char c = in[i];
+        unsigned char value = table[c];
+
+        if (decoder->padding > 0)
+        {
+            // Only padding (and whitespace in MIME mode) may follow padding
+            if ('=' == c && decoder->count + decoder->padding < 4)
+                decoder->padding++;
+            else if (!(mime && b64_is_space(c)))
+                b64_decoder_stop(decoder, decoder->offset + i);
+        }
+        else if (value < 64)
+        {
+            decoder->buf[decoder->count++] = value;
+
+            if (4 == decoder->count)
+            {
+                b64_decode_tmp(dst + size, decoder->buf);
+                decoder->count = 0;
+                size += 3;
+            }
+        }
+        else if ('=' == c && !(decoder->flags & B64_NO_PAD) && decoder->count > 1)
+        {
+            decoder->padding = 1;
+        }
+        else if (!(mime && b64_is_space(c)))
+        {
+            b64_decoder_stop(decoder, decoder->offset + i);
+        }
+
+        i++;
+    }
+
+    decoder->offset += len;
+
+    return size;
+}
+
+size_t b64_decoder_finish(b64_decoder_t* decoder, unsigned char* dst)
+{
+    unsigned char buf[3];
+    size_t size = 0;
+
+    // Check that the final group is complete. A single character is never
+    // valid, and padding is required unless disabled
+    if (1 == decoder->count ||
+        (decoder->count > 1 && decoder->count + decoder->padding < 4 &&
+         (decoder->padding > 0 || !(decoder->flags & B64_NO_PAD))))
+    {
+        b64_decoder_stop(decoder, decoder->offset);
+    }
+
+    // Two or three characters encode one or two bytes
+    if (decoder->count > 1)
+    {
+        size = decoder->count - 1;
+
+        memset(decoder->buf + decoder->count, 0, 4 - decoder->count);
+        b64_decode_tmp(buf, decoder->buf);
+        memcpy(dst, buf, size);
+    }
+
+    decoder->count = 0;
+    decoder->done = 1;
+
+    return size;
+}
+
+/*=============================================================================
+ * Parallel encoding/decoding
+ *============================================================================*/
+
+typedef struct
+{
+    int decode;
+    int flags;
+    int first;     // Chunk starts at the beginning of the input
+    int last;      // Chunk ends at the end of the input
+    void* dst;
+    const void* src;
+    size_t len;
+    size_t size;   // Output size
+    size_t error;  // Offset of the first invalid character (strict mode)
+    int complete;  // All characters were decoded
+} b64_job_t;
+
+static void b64_run_job(b64_job_t* job)
+{
+    if (job->decode)
+    {
+        b64_decoder_t decoder;
+
+        b64_decoder_init(&decoder, job->flags);
+
+        job->size = b64_decoder_update(&decoder,
+                                       (unsigned char*)job->dst,
+                                       (const char*)job->src,
+                                       job->len);
+
+        job->complete = !decoder.done && 0 == decoder.padding;
+
+        // Only the last chunk can end with an incomplete group, unless
+        // decoding stopped early
+        job->size += b64_decoder_finish(&decoder, (unsigned char*)job->dst + job->size);
+
+        job->error = decoder.error;
+    }
+    else
+    {
+        b64_encoder_t encoder;
+
+        b64_encoder_init(&encoder, job->flags);
+
+        // Chunks after the first one start on a new line (MIME only)
+        if (!job->first)
+            encoder.column = B64_MIME_LINE_LEN;
+
+        job->size = b64_encoder_update(&encoder,
+                                       (char*)job->dst,
+                                       (const unsigned char*)job->src,
+                                       job->len);
+
+        if (job->last)
+            job->size += b64_encoder_finish(&encoder, (char*)job->dst + job->size);
+    }
+}
+
+#if defined(B64_WIN32_THREADS)
+
+typedef HANDLE b64_thread_t;
+
+static DWORD WINAPI b64_thread_main(LPVOID arg)
+{
+    b64_run_job((b64_job_t*)arg);
+    return 0;
+}
+
+static int b64_thread_start(b64_thread_t* thread, b64_job_t* job)
+{
+    *thread = CreateThread(NULL, 0, b64_thread_main, job, 0, NULL);
+    return NULL != *thread;
+}
+
+static void b64_thread_join(b64_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+#elif defined(B64_POSIX_THREADS)
+
+typedef pthread_t b64_thread_t;
+
+static void* b64_thread_main(void* arg)
+{
+    b64_run_job((b64_job_t*)arg);
+    return NULL;
+}
+
+static int b64_thread_start(b64_thread_t* thread, b64_job_t* job)
+{
+    return 0 == pthread_create(thread, NULL, b64_thread_main, job);
+}
+
+static void b64_thread_join(b64_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#endif
+
+// Runs the first job on the calling thread and the others on new threads. Jobs
+// whose thread cannot be started also run on the calling thread
+static void b64_run_jobs(b64_job_t* jobs, int count)
+{
+#if defined(B64_WIN32_THREADS) || defined(B64_POSIX_THREADS)
+    b64_thread_t threads[PICO_B64_MAX_THREADS];
+    int started[PICO_B64_MAX_THREADS] = { 0 };
+    int i;
+
+    for (i = 1; i < count; i++)
+    {
+        started[i] = b64_thread_start(&threads[i], &jobs[i]);
+    }
+
+    b64_run_job(&jobs[0]);
+
+    for (i = 1; i < count; i++)
+    {
+        if (started[i])
+            b64_thread_join(threads[i]);
+        else
+            b64_run_job(&jobs[i]);
+    }
+#else
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        b64_run_job(&jobs[i]);
+    }
+#endif
+}
+
+// Splits 'len' into at most 'threads' chunks that are multiples of 'unit'.
+// Returns the number of chunks and stores the chunk size in 'chunk'
+static int b64_split(size_t len, size_t unit, int threads, size_t* chunk)
+{
+    size_t count = len / PICO_B64_MIN_CHUNK;
+
+    if (threads < 1)
+        threads = 1;
+
+    if (threads > PICO_B64_MAX_THREADS)
+        threads = PICO_B64_MAX_THREADS;
+
+    if (count > (size_t)threads)
+        count = threads;
+
+    if (count < 1)
+        count = 1;
+
+    *chunk = (len / count + unit - 1) / unit * unit;
+
+    if (0 == *chunk)
+        return 1;
+
+    return (int)((len + *chunk - 1) / *chunk);
+}
+
+size_t b64_encode_parallel(char* dst,
+                           const unsigned char* src,
+                           size_t len,
+                           int flags,
+                           int threads)
+{
+    b64_job_t jobs[PICO_B64_MAX_THREADS];
+    size_t chunk, size = 0;
+    int i;
+
+    // Chunks hold whole groups, or whole lines in MIME mode
+    size_t unit = (flags & B64_MIME) ? B64_MIME_LINE_LEN / 4 * 3 : 3;
+    int count = b64_split(len, unit, threads, &chunk);
+
+    if (1 == count)
+        return b64_encode_ex(dst, src, len, flags);
+
+    // Query the CPU before starting any threads
+    b64_get_simd();
+
+    for (i = 0; i < count; i++)
+    {
+        size_t offset = i * chunk;
+
+        jobs[i].decode = 0;
+        jobs[i].flags  = flags;
+        jobs[i].first  = (0 == i);
+        jobs[i].last   = (count - 1 == i);
+        jobs[i].dst    = dst + b64_encoded_size_ex(offset, flags);
+        jobs[i].src    = src + offset;
+        jobs[i].len    = jobs[i].last ? len - offset : chunk;
+    }
+
+    b64_run_jobs(jobs, count);
+
+    for (i = 0; i < count; i++)
+    {
+        size += jobs[i].size;
+    }
+
+    return size;
+}
+
+size_t b64_decode_parallel(unsigned char* dst,
+                           const char* src,
+                           size_t len,
+                           int flags,
+                           size_t* error,
+                           int threads)
+{
+    b64_job_t jobs[PICO_B64_MAX_THREADS];
+    size_t chunk, size = 0;
+    int i;
+
+    int count = b64_split(len, 4, threads, &chunk);
+
+    if (1 == count || (flags & B64_MIME))
+        return b64_decode_ex(dst, src, len, flags, error);
+
+    // Query the CPU before starting any threads
+    b64_get_simd();
+
+    for (i = 0; i < count; i++)
+    {
+        size_t offset = i * chunk;
+
+        jobs[i].decode = 1;
+        jobs[i].flags  = flags;
+        jobs[i].first  = (0 == i);
+        jobs[i].last   = (count - 1 == i);
+        jobs[i].dst    = dst + offset / 4 * 3;
+        jobs[i].src    = src + offset;
+        jobs[i].len    = jobs[i].last ? len - offset : chunk;
+    }
+
+    b64_run_jobs(jobs, count);
+
+    if (error)
+        *error = B64_NO_ERROR;
+
+    // Decoding stops in the first chunk that was not decoded completely. The
+    // output of later chunks is discarded
+    for (i = 0; i < count; i++)
+    {
+        size += jobs[i].size;
+
+        if (B64_NO_ERROR != jobs[i].error)
+        {
+            if (error)
+                *error = i * chunk + jobs[i].error;
+
+            break;
+        }
+
+        if (!jobs[i].last && !jobs[i].complete)
+        {
+            // Anything after complete padding is invalid
+            if (error && (flags & B64_STRICT))
+                *error = (i + 1) * chunk;
+
+            break;
         }
     }
 
@@ -45,6 +45,46 @@
     this function pointer is passed true the lock is acquired and false to
     release the lock.
 
+    Each thread has its own logging context: a thread ID assigned by the logger
+    and a few integer fields set with `log_set_context` (e.g. a frame number or
+    request ID). The context is captured with every entry and can be displayed
+    per appender using `log_display_context`. Entries are staged on the calling
+    thread, so the only synchronization needed is around the appenders
+    themselves (see `log_set_lock`), and in asynchronous mode only the
+    `log_drain` thread calls the appenders.
+
+    Appenders can also produce structured output for log shippers. Setting the
+    format of an appender to `LOG_FORMAT_JSON` or `LOG_FORMAT_LOGFMT` with
+    `log_set_format` replaces the text layout with one JSON object or logfmt
+    line per entry containing typed fields: level, ts_ns (nanoseconds since
+    the epoch), file, line, func, thread, the thread context fields, and msg.
+
+    Repetitive messages can be rate limited with `log_set_rate_limit`. Each call
+    site (file and line) is allowed a number of messages per second plus a
+    burst. Excess messages are dropped and summarized by a "Suppressed N
+    similar messages" entry when the call site is allowed to log again.
+
+    Files are best written with the appender registered by `log_add_file`. It
+    batches entries in a user supplied buffer, flushes according to a size,
+    time and severity policy, and rotates the file by size or age.
+
+    Slow appenders (files, pipes, etc...) can be taken off the calling thread by
+    enabling asynchronous logging with `log_enable_async`. In this mode
+    `log_write` copies the message into a fixed size lock-free queue and
+    returns. Entries are dispatched to the appenders by `log_drain`, which the
+    application calls from a thread of its choosing (usually a background
+    thread running in a loop). This keeps the library free of any threading
+    dependencies. The queue requires atomic operations, which are provided for
+    GCC, Clang, and MSVC.
+
+    For very hot code paths there is also deferred logging. The `log_deferred`
+    macro does not format the message. It stores the format string pointer,
+    the arguments, the timestamp and the level in a buffer owned by the calling
+    thread (see `log_set_deferred_buffer`). The records are formatted and
+    dispatched later by `log_flush_deferred` or `log_decode_deferred`. The
+    latter can run on any thread, e.g. a background thread that receives
+    full buffers from the workers.
+
     Please see the examples for more details.
 
     Usage:
@@ -62,10 +102,34 @@
 
     - PICO_LOG_MAX_APPENDERS (default: 16)
     - PICO_LOG_MAX_MSG_LENGTH (default: 1024)
+    - PICO_LOG_QUEUE_SIZE (default: 64, must be a power of two)
+    - PICO_LOG_MAX_CONTEXT (default: 4)
+    - PICO_LOG_RATE_LIMIT_SITES (default: 256)
 
     Must be defined before PICO_LOG_IMPLEMENTATION
+
+    - PICO_LOG_NO_POSIX_CLOCK
+
+    On POSIX systems the implementation reads the time with clock_gettime,
+    which requires _POSIX_C_SOURCE 199309L or higher. The header defines it
+    when PICO_LOG_IMPLEMENTATION is set, which only takes effect if no other
+    header was included before it in that file (otherwise define it before any
+    include or in the build system). Define this macro to skip the POSIX clocks
+    and fall back to time() and localtime() (second resolution, not thread
+    safe).
+
+    - PICO_LOG_MIN_LEVEL (default: 0)
+
+    Messages below this level (0 = TRACE, 1 = DEBUG, ..., 5 = FATAL) are
+    removed at compile time. Must be defined before including the header.
 */
 
+// The POSIX clocks are hidden in strict ISO C modes (e.g. -std=c99)
+#if defined(PICO_LOG_IMPLEMENTATION) && !defined(PICO_LOG_NO_POSIX_CLOCK) && \
+    !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #ifndef PICO_LOG_H
 #define PICO_LOG_H
 
@@ -112,6 +176,34 @@ typedef void (*log_appender_lock_fn)(bool lock, void *udata);
  */
 typedef int log_appender_t;
 
+/**
+ * @brief Entry layouts, see `log_set_format`.
+ */
+typedef enum
+{
+    LOG_FORMAT_TEXT,  //!< Human readable text (default)
+    LOG_FORMAT_JSON,  //!< One JSON object per line
+    LOG_FORMAT_LOGFMT //!< One line of space separated key=value pairs
+} log_format_t;
+
+/**
+ * @brief Determines what happens when a message is logged while the
+ * asynchronous queue is full.
+ */
+typedef enum
+{
+    LOG_ASYNC_DROP,  //!< Discard the message (see `log_dropped_count`)
+    LOG_ASYNC_BLOCK  //!< Wait until `log_drain` frees a slot
+} log_async_policy_t;
+
+/**
+ * @brief The lowest level accepted by an enabled appender. Messages below this
+ * level are filtered out by the logging macros before their arguments are
+ * evaluated. NOTE: This value is maintained by the logger and must not be
+ * modified. It is read atomically with PICO_LOG_ACTIVE_LEVEL().
+ */
+extern log_level_t log_active_level;
+
 /**
   * @brief Converts a string to the corresponding log level
   */
@@ -145,7 +237,8 @@ void log_disable(void);
  *                    If not required, pass in NULL for this parameter.
  *
  * @return            An identifier for the appender. This ID is valid until the
- *                    appender is unregistered.
+ *                    appender is unregistered. Returns -1 if all
+ *                    PICO_LOG_MAX_APPENDERS slots are in use.
  */
 log_appender_t log_add_appender(log_appender_fn appender_fp,
                                 log_level_t level,
@@ -158,10 +251,80 @@ log_appender_t log_add_appender(log_appender_fn appender_fp,
  * @param level  The appender's log level
  *
  * @return       An identifier for the appender. This ID is valid until the
- *               appender is unregistered.
+ *               appender is unregistered, or -1 if no appender slot is free.
  */
 log_appender_t log_add_stream(FILE* stream, log_level_t level);
 
+/**
+ * @brief File appender settings
+ */
+typedef struct
+{
+    char*  buffer;          //!< Memory used to batch entries (NULL to disable)
+    size_t buffer_size;     //!< Size of the buffer in bytes
+    long   flush_interval;  //!< Flush buffered entries that are older than
+                            //!< this many milliseconds (0 to disable)
+    size_t max_file_size;   //!< Rotate once the file would exceed this many
+                            //!< bytes (0 to disable)
+    long   rotate_interval; //!< Rotate after this many seconds (0 to disable)
+    int    max_backups;     //!< Number of rotated files to keep, named
+                            //!< path.1 (newest) to path.N (oldest)
+} log_file_config_t;
+
+/**
+ * @brief Registers a buffered file appender.
+ *
+ * Entries are appended to the buffer and written to the file in batches: when
+ * the buffer is full, when the oldest buffered entry is older than the flush
+ * interval, when a FATAL entry is logged, and when `log_flush` is called.
+ * The file is opened in append mode.
+ *
+ * The flush interval is checked when an entry is written and whenever
+ * `log_drain` is called, so an idle appender still writes its buffer once the
+ * interval has passed as long as `log_drain` is called periodically. This
+ * works in synchronous mode too. Call `log_flush` before exiting to ensure
+ * everything is written.
+ *
+ * In asynchronous mode the writes, and any rotation, happen on the thread
+ * calling `log_drain`. In synchronous mode they happen on the logging thread,
+ * which is blocked while the files are renamed, so enable asynchronous mode to
+ * keep rotation off latency sensitive threads.
+ *
+ * @param path   The path of the log file
+ * @param level  The appender's log level
+ * @param config The appender settings, or NULL for an unbuffered file that is
+ *               never rotated. The buffer must remain valid until the appender
+ *               is removed.
+ *
+ * @return       An identifier for the appender, or -1 if the file could not be
+ *               opened or no appender slot is free
+ */
+log_appender_t log_add_file(const char* path,
+                            log_level_t level,
+                            const log_file_config_t* config);
+
+/**
+ * @brief Writes any buffered entries to their files.
+ */
+void log_flush(void);
+
+/**
+ * @brief Limits how often each call site may log.
+ *
+ * Every call site (identified by file and line) gets a token bucket that
+ * refills at `rate` messages per second and holds up to `burst` messages.
+ * Messages that exceed the limit are dropped. The next message allowed from
+ * that call site is preceded by an entry reporting how many were suppressed.
+ * Checking the limit does not take any locks. Up to PICO_LOG_RATE_LIMIT_SITES
+ * call sites are tracked, beyond that messages are not limited.
+ *
+ * NOTE: Rate limiting is off by default.
+ *
+ * @param rate  Messages per second per call site (0 to disable)
+ * @param burst Messages that may be logged in quick succession (at least 1)
+ */
+void log_set_rate_limit(unsigned rate, unsigned burst);
+
 /**
  * @brief Unregisters appender (removes the appender from the logger).
  *
@@ -210,10 +373,22 @@ void log_set_level(log_appender_t id, log_level_t level);
  * https://man7.org/linux/man-pages/man3/strftime.3.html
  *
  * @param id The appender id
- * @param fmt The time format
+ * @param fmt The time format. Formats longer than 31 characters are truncated
  */
 void log_set_time_fmt(log_appender_t id, const char* fmt);
 
+/**
+ * @brief Sets the number of sub-second digits in the appender timestamp.
+ * NOTE: Zero by default.
+ *
+ * The digits are appended after the formatted time (e.g. "12:30:00.123"). The
+ * digits are always zero without the POSIX clocks (see PICO_LOG_NO_POSIX_CLOCK).
+ *
+ * @param id     The appender id
+ * @param digits The number of digits (0 to 9)
+ */
+void log_set_time_precision(log_appender_t id, int digits);
+
 /**
  * @brief Turns colors ouput on or off for the specified appender.
  * NOTE: Off by default.
@@ -260,14 +435,130 @@ void log_display_file(log_appender_t id, bool enabled);
  */
 void log_display_function(log_appender_t id, bool enabled);
 
+/**
+ * @brief Turns thread context reporting on/off for the specified appender.
+ * The context is displayed as "[thread=1 key=value ...]".
+ * NOTE: Off by default.
+ *
+ * @param id      The appender id
+ * @param enabled On if true
+ */
+void log_display_context(log_appender_t id, bool enabled);
+
+/**
+ * @brief Sets the entry layout of the specified appender.
+ * NOTE: LOG_FORMAT_TEXT by default.
+ *
+ * The structured formats ignore the log_display* settings and always include
+ * every field. For example, in JSON:
+ *
+ * {"level":"INFO","ts_ns":1700000000123456789,"file":"main.c","line":42,
+ *  "func":"main","thread":1,"frame":7,"msg":"Hello"}
+ *
+ * Messages are escaped and truncated if the escaped entry does not fit.
+ *
+ * @param id     The appender id
+ * @param format The entry layout
+ */
+void log_set_format(log_appender_t id, log_format_t format);
+
+/**
+ * @brief Sets a context field for the calling thread
+ *
+ * The field is attached to every entry logged by the thread until it is
+ * changed or cleared. Setting an existing key updates its value. At most
+ * PICO_LOG_MAX_CONTEXT fields can be set per thread.
+ *
+ * @param key   The field name. Only the pointer is stored, so the string must
+ *              remain valid (string literals are ideal). Structured formats
+ *              escape it in JSON and replace spaces, '=', quotes, backslashes
+ *              and control characters with '_' in logfmt.
+ * @param value The field value
+ */
+void log_set_context(const char* key, long long value);
+
+/**
+ * @brief Removes all context fields of the calling thread.
+ */
+void log_clear_context(void);
+
+/**
+ * @brief Returns the ID the logger assigned to the calling thread. IDs are
+ * assigned sequentially, starting at 1, when a thread first logs or calls
+ * this function.
+ */
+unsigned log_thread_id(void);
+
+/**
+ * @brief Enables asynchronous logging.
+ *
+ * Instead of calling the appenders, `log_write` formats the message and copies
+ * it, along with its metadata, into a fixed size lock-free queue. The entries
+ * are assembled and dispatched to the appenders by `log_drain`. This function
+ * should be called before other threads start logging.
+ *
+ * @param policy What to do when the queue is full. If the policy is
+ *               `LOG_ASYNC_BLOCK`, `log_drain` must be running on another
+ *               thread, otherwise a full queue will deadlock.
+ */
+void log_enable_async(log_async_policy_t policy);
+
+/**
+ * @brief Disables asynchronous logging. Queued entries are dispatched before
+ * returning. The thread calling `log_drain` must be stopped first.
+ */
+void log_disable_async(void);
+
+/**
+ * @brief Dispatches queued entries to the appenders. Only one thread may call
+ * this function at a time.
+ *
+ * Once the queue is empty, buffered appenders whose flush interval has passed
+ * are flushed (see `log_add_file`).
+ *
+ * @return The number of entries dispatched
+ */
+size_t log_drain(void);
+
+/**
+ * @brief Returns the number of entries discarded because the queue was full.
+ */
+size_t log_dropped_count(void);
+
+#ifndef PICO_LOG_MIN_LEVEL
+#define PICO_LOG_MIN_LEVEL 0
+#endif
+
+/*
+ * Reads log_active_level, which may be updated while other threads log. The
+ * load is atomic but relaxed since the level is only a filter.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+    #define PICO_LOG_ACTIVE_LEVEL() \
+            __atomic_load_n(&log_active_level, __ATOMIC_RELAXED)
+#else
+    #define PICO_LOG_ACTIVE_LEVEL() (*(volatile log_level_t*)&log_active_level)
+#endif
+
+/*
+ * Calls log_write if the level is enabled at runtime
+ */
+#define PICO_LOG_WRITE_IF_ACTIVE(level, ...) \
+        ((level) >= PICO_LOG_ACTIVE_LEVEL() \
+            ? log_write(level, __FILE__, __LINE__, __func__, __VA_ARGS__) \
+            : (void)0)
+
 /**
  * @brief Logs a TRACE an INFO message
  *
  * Writes a TRACE level message to the log. Usage is similar to printf
  * (i.e. log_trace(format, args...))
  */
-#define log_trace(...) \
-        log_write(LOG_LEVEL_TRACE, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 0
+#define log_trace(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define log_trace(...) ((void)0)
+#endif
 
 /**
  * @brief Logs a DEBUG message
@@ -275,8 +566,11 @@ void log_display_function(log_appender_t id, bool enabled);
  * Writes a DEBUG level message to the log. Usage is similar to printf (i.e.
  * (i.e. log_debug(format, args...))
  */
-#define log_debug(...) \
-        log_write(LOG_LEVEL_DEBUG, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 1
+#define log_debug(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...) ((void)0)
+#endif
 
 /**
  * @brief Logs an INFO message
@@ -284,8 +578,11 @@ void log_display_function(log_appender_t id, bool enabled);
  * Writes an INFO level message to the log. Usage is similar to printf
  * (i.e. log_info(format, args...))
  */
-#define log_info(...) \
-        log_write(LOG_LEVEL_INFO,  __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 2
+#define log_info(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define log_info(...) ((void)0)
+#endif
 
 /**
  * @brief Logs a WARN message
@@ -293,8 +590,11 @@ void log_display_function(log_appender_t id, bool enabled);
  * Writes a WARN level message to the log. Usage is similar to printf (i.e.
  * (i.e. log_warn(format, args...))
  */
-#define log_warn(...) \
-        log_write(LOG_LEVEL_WARN,  __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 3
+#define log_warn(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define log_warn(...) ((void)0)
+#endif
 
 /**
  * @brief Logs an ERROR message
@@ -302,8 +602,11 @@ void log_display_function(log_appender_t id, bool enabled);
  * Writes a ERROR level message to the log. Usage is similar to printf (i.e.
  * (i.e. log_error(format, args...))
  */
-#define log_error(...) \
-        log_write(LOG_LEVEL_ERROR, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 4
+#define log_error(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define log_error(...) ((void)0)
+#endif
 
 /**
  * @brief Logs a FATAL message
@@ -311,8 +614,11 @@ void log_display_function(log_appender_t id, bool enabled);
  * Writes a FATAL level message to the log.. Usage is similar to printf (i.e.
  * (i.e. log_fatal(format, args...))
  */
-#define log_fatal(...) \
-        log_write(LOG_LEVEL_FATAL, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#if PICO_LOG_MIN_LEVEL <= 5
+#define log_fatal(...) PICO_LOG_WRITE_IF_ACTIVE(LOG_LEVEL_FATAL, __VA_ARGS__)
+#else
+#define log_fatal(...) ((void)0)
+#endif
 
 
 /**
@@ -328,6 +634,75 @@ void log_write(log_level_t level,
                const char* func,
                const char* fmt, ...);
 
+/**
+ * @brief Records a message in the calling thread's deferred buffer
+ *
+ * Usage is similar to the other logging macros except that the level comes
+ * first (i.e. log_deferred(LOG_LEVEL_TRACE, format, args...)). Nothing is
+ * formatted at the call site. Strings (`%s`) are copied into the buffer and all
+ * other arguments are stored by value. `%n` is ignored. The format string
+ * itself is not copied, so it must remain valid until the record is decoded
+ * (string literals are ideal).
+ *
+ * If the calling thread has no deferred buffer, the message is written
+ * immediately, as with `log_write`. Constant levels below PICO_LOG_MIN_LEVEL
+ * are removed by the compiler.
+ */
+#define log_deferred(level, ...) \
+        (((level) >= PICO_LOG_MIN_LEVEL && \
+          (level) >= PICO_LOG_ACTIVE_LEVEL()) \
+            ? log_write_deferred(level, __FILE__, __LINE__, __func__, __VA_ARGS__) \
+            : (void)0)
+
+/**
+ * @brief Sets the deferred buffer of the calling thread
+ *
+ * Records are appended to this buffer by `log_deferred`. If a record does not
+ * fit, the buffer is flushed on the calling thread first. The previous buffer
+ * is not flushed. Instead the number of bytes recorded in it is returned, so
+ * that it can be decoded later, possibly on another thread.
+ *
+ * @param buffer The new buffer or NULL to disable deferred logging
+ * @param size   The size of the buffer in bytes
+ *
+ * @return       The number of bytes recorded in the previous buffer
+ */
+size_t log_set_deferred_buffer(void* buffer, size_t size);
+
+/**
+ * @brief Formats and dispatches the records in the calling thread's deferred
+ * buffer, then empties it.
+ *
+ * @return The number of records dispatched
+ */
+size_t log_flush_deferred(void);
+
+/**
+ * @brief Formats and dispatches records in a deferred buffer
+ *
+ * This function may be called from any thread, but must be called within the
+ * process that recorded the data, since records reference format strings by
+ * address.
+ *
+ * @param data A buffer previously passed to `log_set_deferred_buffer`
+ * @param size The number of bytes recorded in the buffer
+ *
+ * @return     The number of records dispatched
+ */
+size_t log_decode_deferred(const void* data, size_t size);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. Use the
+ * `log_deferred` macro instead.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((format(printf, 5, 6)))
+#endif
+void log_write_deferred(log_level_t level,
+                        const char* file,
+                        unsigned line,
+                        const char* func,
+                        const char* fmt, ...);
 
 #ifdef __cplusplus
 }
@@ -338,6 +713,7 @@ void log_write(log_level_t level,
 #ifdef PICO_LOG_IMPLEMENTATION
 
 #include <time.h>
+#include <stdint.h>
 #include <string.h>
 
 /*
@@ -351,6 +727,18 @@ void log_write(log_level_t level,
 #define PICO_LOG_MAX_MSG_LENGTH 1024
 #endif
 
+#ifndef PICO_LOG_QUEUE_SIZE
+#define PICO_LOG_QUEUE_SIZE 64
+#endif
+
+#ifndef PICO_LOG_MAX_CONTEXT
+#define PICO_LOG_MAX_CONTEXT 4
+#endif
+
+#ifndef PICO_LOG_RATE_LIMIT_SITES
+#define PICO_LOG_RATE_LIMIT_SITES 256
+#endif
+
 #ifdef NDEBUG
     #define PICO_LOG_ASSERT(expr) ((void)0)
 #else
@@ -366,8 +754,157 @@ void log_write(log_level_t level,
 
 #define LOG_MAX_APPENDERS  PICO_LOG_MAX_APPENDERS
 #define LOG_MAX_MSG_LENGTH PICO_LOG_MAX_MSG_LENGTH
+#define LOG_QUEUE_SIZE     PICO_LOG_QUEUE_SIZE
+#define LOG_MAX_CONTEXT    PICO_LOG_MAX_CONTEXT
+#define LOG_RATE_SITES     PICO_LOG_RATE_LIMIT_SITES
 #define LOG_ASSERT         PICO_LOG_ASSERT
 
+/*
+ * Atomic operations used by the asynchronous queue, thread IDs and the rate
+ * limiter. The 64-bit variants operate on long long.
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define LOG_ATOMIC_LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+    #define LOG_ATOMIC_STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+    #define LOG_ATOMIC_INC(ptr)        __atomic_add_fetch(ptr, 1, __ATOMIC_RELAXED)
+    #define LOG_ATOMIC_XCHG(ptr, val)  __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL)
+    #define LOG_ATOMIC_CAS(ptr, expected, desired) \
+            __atomic_compare_exchange_n(ptr, expected, desired, false, \
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+    #define LOG_ATOMIC_LOAD64(ptr)     LOG_ATOMIC_LOAD(ptr)
+    #define LOG_ATOMIC_CAS64(ptr, expected, desired) \
+            LOG_ATOMIC_CAS(ptr, expected, desired)
+#elif defined(_MSC_VER)
+    #include <intrin.h>
+
+    #define LOG_ATOMIC_LOAD(ptr) \
+            ((unsigned)_InterlockedOr((volatile long*)(ptr), 0))
+
+    #define LOG_ATOMIC_STORE(ptr, val) \
+            ((void)_InterlockedExchange((volatile long*)(ptr), (long)(val)))
+
+    #define LOG_ATOMIC_INC(ptr) \
+            ((unsigned)_InterlockedIncrement((volatile long*)(ptr)))
+
+    #define LOG_ATOMIC_XCHG(ptr, val) \
+            ((unsigned)_InterlockedExchange((volatile long*)(ptr), (long)(val)))
+
+    #define LOG_ATOMIC_CAS(ptr, expected, desired) \
+            log_atomic_cas(ptr, expected, desired)
+
+    #define LOG_ATOMIC_LOAD64(ptr) \
+            _InterlockedCompareExchange64((volatile long long*)(ptr), 0, 0)
+
+    #define LOG_ATOMIC_CAS64(ptr, expected, desired) \
+            log_atomic_cas64(ptr, expected, desired)
+
+    static bool log_atomic_cas(unsigned* ptr, unsigned* expected, unsigned desired)
+    {
+        unsigned prev = (unsigned)_InterlockedCompareExchange((volatile long*)ptr,
+                                                              (long)desired,
+                                                              (long)*expected);
+        if (prev == *expected)
+            return true;
+
+        *expected = prev;
+        return false;
+    }
+
+    static bool log_atomic_cas64(long long* ptr, long long* expected, long long desired)
+    {
+        long long prev = _InterlockedCompareExchange64((volatile long long*)ptr,
+                                                       desired, *expected);
+        if (prev == *expected)
+            return true;
+
+        *expected = prev;
+        return false;
+    }
+#else
+    // Asynchronous logging is unavailable, see log_enable_async
+    #define LOG_NO_ATOMICS
+
+    #define LOG_ATOMIC_LOAD(ptr)       (*(ptr))
+    #define LOG_ATOMIC_STORE(ptr, val) ((void)(*(ptr) = (val)))
+    #define LOG_ATOMIC_INC(ptr)        (++(*(ptr)))
+    #define LOG_ATOMIC_XCHG(ptr, val)  log_exchange(ptr, val)
+    #define LOG_ATOMIC_CAS(ptr, expected, desired) \
+            (*(ptr) == *(expected) ? (*(ptr) = (desired), true) \
+                                   : (*(expected) = *(ptr), false))
+
+    #define LOG_ATOMIC_LOAD64(ptr)     LOG_ATOMIC_LOAD(ptr)
+    #define LOG_ATOMIC_CAS64(ptr, expected, desired) \
+            LOG_ATOMIC_CAS(ptr, expected, desired)
+
+    static unsigned log_exchange(unsigned* ptr, unsigned val)
+    {
+        unsigned prev = *ptr;
+        *ptr = val;
+        return prev;
+    }
+#endif
+
+/*
+ * Spin-wait hint and thread yield used while waiting for the asynchronous
+ * queue to drain.
+ */
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    #define LOG_CPU_PAUSE() _mm_pause()
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+    #define LOG_CPU_PAUSE() __yield()
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__i386__) || defined(__x86_64__))
+    #define LOG_CPU_PAUSE() __builtin_ia32_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__arm__) || defined(__aarch64__))
+    #define LOG_CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+    #define LOG_CPU_PAUSE() ((void)0)
+#endif
+
+#if defined(_WIN32) || defined(_WIN64) || defined (__CYGWIN__)
+    #include <windows.h>
+    #define LOG_YIELD() ((void)SwitchToThread())
+#elif defined(__unix__) || defined(__unix) || defined(__APPLE__)
+    #include <sched.h>
+    #define LOG_YIELD() ((void)sched_yield())
+#else
+    #define LOG_YIELD() LOG_CPU_PAUSE()
+#endif
+
+#define LOG_SPIN_COUNT 64 // Spins before yielding the time slice
+
+/*
+ * Thread local storage used by the deferred buffers
+ */
+
+#if defined(_MSC_VER)
+    #define LOG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+    #define LOG_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define LOG_THREAD_LOCAL _Thread_local
+#else
+    #define LOG_THREAD_LOCAL // Only a single thread may use deferred logging
+#endif
+
+/*
+ * Platform clocks. Timestamps are read from a monotonic clock plus an offset
+ * to the wall clock measured at initialization.
+ */
+
+#if defined(_WIN32) || defined(_WIN64) || defined (__CYGWIN__)
+    #define LOG_WINDOWS_CLOCK
+    #include <windows.h>
+#elif defined(PICO_LOG_NO_POSIX_CLOCK)
+    // Second resolution timestamps from time() and localtime()
+#elif defined(CLOCK_MONOTONIC) && defined(CLOCK_REALTIME)
+    #define LOG_POSIX_CLOCK
+#endif
+
 /*
  * Log entry component maximum sizes. These have been chosen to be overly
  * generous powers of 2 for the sake of safety and simplicity.
@@ -377,6 +914,7 @@ void log_write(log_level_t level,
 #define LOG_LEVEL_LEN     32
 #define LOG_FILE_LEN      512
 #define LOG_FUNC_LEN      32
+#define LOG_CONTEXT_LEN   256
 #define LOG_MSG_LEN       LOG_MAX_MSG_LENGTH
 #define LOG_BREAK_LEN     1
 
@@ -384,10 +922,12 @@ void log_write(log_level_t level,
                        LOG_LEVEL_LEN      + \
                        LOG_FILE_LEN       + \
                        LOG_FUNC_LEN       + \
+                       LOG_CONTEXT_LEN    + \
                        LOG_MSG_LEN        + \
                        LOG_BREAK_LEN)
 
 #define LOG_TIME_FMT_LEN 32
+#define LOG_PATH_LEN     256
 #define LOG_TIME_FMT     "%d/%m/%Y %H:%M:%S"
 
 #define LOG_TERM_CODE  0x1B
@@ -398,6 +938,8 @@ static bool log_initialized    = false; // True if logger is initialized
 static bool log_enabled        = true;  // True if logger is enabled
 static int  log_appender_count = 0;     // Number of appenders
 
+log_level_t log_active_level = LOG_LEVEL_COUNT; // Nothing is enabled yet
+
 /*
  * Logger level strings indexed by level ID (log_level_t).
  */
@@ -432,6 +974,11 @@ static const char* log_level_color[] =
     "[94m", "[36m", "[32m", "[33m", "[31m", "[35m", NULL
 };
 
+/*
+ * Hooks implemented by built-in appenders that buffer their output.
+ */
+typedef void (*log_appender_hook_fn)(void* udata);
+
 /*
  * Appender pointer and metadata.
  */
@@ -439,16 +986,22 @@ typedef struct
 {
     log_appender_fn      appender_fp;
     void*                udata;
+    log_appender_hook_fn flush_fp;
+    log_appender_hook_fn close_fp;
+    log_appender_hook_fn tick_fp;
     log_appender_lock_fn lock_fp;
     void*                lock_udata;
     bool                 enabled;
     log_level_t          log_level;
     char                 time_fmt[LOG_TIME_FMT_LEN];
+    int                  time_precision;
     bool                 colors;
     bool                 timestamp;
     bool                 level;
     bool                 file;
     bool                 func;
+    bool                 context;
+    log_format_t         format;
 } log_appender_data_t;
 
 /*
@@ -457,65 +1010,231 @@ typedef struct
 static log_appender_data_t log_appenders[LOG_MAX_APPENDERS];
 
 /*
- * Initializes the logger provided it has not been initialized.
+ * Thread context captured with each entry.
  */
-static void
-log_try_init (void)
+typedef struct
 {
-    if (log_initialized)
-    {
-        return;
-    }
+    unsigned    thread;                // Zero until an ID is assigned
+    unsigned    count;                 // Number of fields
+    const char* keys[LOG_MAX_CONTEXT];
+    long long   values[LOG_MAX_CONTEXT];
+} log_context_t;
 
-    for (int i = 0; i < LOG_MAX_APPENDERS; i++)
-    {
-        log_appenders[i].appender_fp = NULL;
-    }
+static LOG_THREAD_LOCAL log_context_t log_context;
 
-    log_initialized = true;
-}
+static unsigned log_thread_count = 0; // Number of thread IDs assigned
 
-static bool log_appender_exists(log_appender_t id)
+/*
+ * A log entry prior to being assembled by the appenders.
+ */
+typedef struct
 {
-    log_try_init();
-
-    return (id < LOG_MAX_APPENDERS && NULL != log_appenders[id].appender_fp);
-}
+    log_context_t context;
+    log_level_t level;
+    const char* file;
+    unsigned    line;
+    const char* func;
+    time_t      time;
+    long        nsec;
+    char        msg[LOG_MSG_LEN];
+} log_record_t;
 
-static bool log_appender_enabled(log_appender_t id)
+/*
+ * Asynchronous queue cell. The sequence number tells producers and the
+ * consumer whether the cell is free (seq == position) or holds a record that
+ * is ready to be dispatched (seq == position + 1).
+ */
+typedef struct
 {
-    log_try_init();
+    unsigned     seq;
+    log_record_t record;
+} log_queue_cell_t;
 
-    return log_appender_exists(id) && log_appenders[id].enabled;
-}
+/*
+ * Bounded multi-producer, single-consumer queue of records. Positions are
+ * free running counters, so the size must be a power of two for the cell
+ * indices to remain consistent when the counters wrap around.
+ */
+static log_queue_cell_t   log_queue[LOG_QUEUE_SIZE];
+static unsigned           log_queue_head = 0; // Next position to dispatch
+static unsigned           log_queue_tail = 0; // Next position to claim
+static unsigned           log_dropped    = 0; // Number of dropped records
+static unsigned           log_async      = 0; // Non-zero in asynchronous mode
+static log_async_policy_t log_async_policy = LOG_ASYNC_DROP;
 
-bool log_str_to_level(const char* str, log_level_t* level)
+/*
+ * Wall clock minus monotonic clock in nanoseconds, measured at initialization.
+ */
+static long long log_clock_offset = 0;
+
+#if defined(LOG_WINDOWS_CLOCK)
+static LARGE_INTEGER log_clock_freq;
+#endif
+
+/*
+ * Returns the monotonic clock in nanoseconds.
+ */
+static long long
+log_monotonic_ns (void)
 {
-    if (!level)
-        return false;
+#if defined(LOG_WINDOWS_CLOCK)
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
 
-    for (int i = 0; log_level_str[i]; i++)
-    {
-        if (0 == strcmp(str, log_level_str[i]))
-        {
-            *level = (log_level_t)i;
-            return true;
-        }
-    }
+    long long sec = ticks.QuadPart / log_clock_freq.QuadPart;
+    long long rem = ticks.QuadPart % log_clock_freq.QuadPart;
 
-    return false;
+    return sec * 1000000000LL + rem * 1000000000LL / log_clock_freq.QuadPart;
+#elif defined(LOG_POSIX_CLOCK)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return (long long)time(0) * 1000000000LL;
+#endif
 }
 
-void
-log_enable (void)
+/*
+ * Returns the wall clock in nanoseconds since the epoch.
+ */
+static long long
+log_wall_ns (void)
 {
-    log_enabled = true;
-}
+#if defined(LOG_WINDOWS_CLOCK)
+    // 100 nanosecond intervals since January 1, 1601
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+
+    ULARGE_INTEGER ticks;
+    ticks.LowPart  = ft.dwLowDateTime;
+    ticks.HighPart = ft.dwHighDateTime;
+
+    return ((long long)ticks.QuadPart - 116444736000000000LL) * 100LL;
+#elif defined(LOG_POSIX_CLOCK)
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return (long long)time(0) * 1000000000LL;
+#endif
+}
+
+static void
+log_init_clock (void)
+{
+#if defined(LOG_WINDOWS_CLOCK)
+    QueryPerformanceFrequency(&log_clock_freq);
+#endif
+
+    log_clock_offset = log_wall_ns() - log_monotonic_ns();
+}
+
+/*
+ * Returns the current time in nanoseconds since the epoch.
+ */
+static long long
+log_now (void)
+{
+    return log_monotonic_ns() + log_clock_offset;
+}
+
+/*
+ * Splits a time in nanoseconds into seconds and nanoseconds.
+ */
+static void
+log_split_time (long long ns, time_t* time, long* nsec)
+{
+    *time = (time_t)(ns / 1000000000LL);
+    *nsec = (long)(ns % 1000000000LL);
+}
+
+/*
+ * Initializes the logger provided it has not been initialized.
+ */
+static void
+log_try_init (void)
+{
+    if (log_initialized)
+    {
+        return;
+    }
+
+    for (int i = 0; i < LOG_MAX_APPENDERS; i++)
+    {
+        log_appenders[i].appender_fp = NULL;
+    }
+
+    log_init_clock();
+
+    log_initialized = true;
+}
+
+static bool log_appender_exists(log_appender_t id)
+{
+    log_try_init();
+
+    return (id >= 0 && id < LOG_MAX_APPENDERS &&
+            NULL != log_appenders[id].appender_fp);
+}
+
+static bool log_appender_enabled(log_appender_t id)
+{
+    log_try_init();
+
+    return log_appender_exists(id) && log_appenders[id].enabled;
+}
+
+/*
+ * Recomputes the lowest level accepted by an enabled appender. Called whenever
+ * the logger or appender configuration changes.
+ */
+static void
+log_update_active_level (void)
+{
+    log_level_t level = LOG_LEVEL_COUNT;
+
+    for (log_appender_t i = 0; log_enabled && i < LOG_MAX_APPENDERS; i++)
+    {
+        if (log_appender_enabled(i) && log_appenders[i].log_level < level)
+        {
+            level = log_appenders[i].log_level;
+        }
+    }
+
+    LOG_ATOMIC_STORE(&log_active_level, level);
+}
+
+bool log_str_to_level(const char* str, log_level_t* level)
+{
+    if (!level)
+        return false;
+
+    for (int i = 0; log_level_str[i]; i++)
+    {
+        if (0 == strcmp(str, log_level_str[i]))
+        {
+            *level = (log_level_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+log_enable (void)
+{
+    log_enabled = true;
+    log_update_active_level();
+}
 
 void
 log_disable (void)
 {
     log_enabled = false;
+    log_update_active_level();
 }
 
 log_appender_t
@@ -527,6 +1246,9 @@ log_add_appender (log_appender_fn appender_fp, log_level_t level, void* udata)
     // Check if there is space for a new appender.
     LOG_ASSERT(log_appender_count < LOG_MAX_APPENDERS);
 
+    if (log_appender_count >= LOG_MAX_APPENDERS)
+        return -1;
+
     // Ensure level is valid
     LOG_ASSERT(level >= 0 && level < LOG_LEVEL_COUNT);
 
@@ -548,20 +1270,29 @@ log_add_appender (log_appender_fn appender_fp, log_level_t level, void* udata)
             appender->timestamp   = false;
             appender->file        = false;
             appender->func        = false;
+            appender->context     = false;
+            appender->format      = LOG_FORMAT_TEXT;
             appender->lock_fp     = NULL;
             appender->lock_udata  = NULL;
+            appender->flush_fp    = NULL;
+            appender->close_fp    = NULL;
+            appender->tick_fp     = NULL;
+
+            appender->time_precision = 0;
 
             strncpy(appender->time_fmt, LOG_TIME_FMT, LOG_TIME_FMT_LEN);
 
             log_appender_count++;
 
+            log_update_active_level();
+
             return (log_appender_t)i;
         }
     }
 
     // This should never happen
     LOG_ASSERT(false);
-    return 0;
+    return -1;
 }
 
 static void
@@ -581,6 +1312,259 @@ log_add_stream (FILE* stream, log_level_t level)
     return log_add_appender(log_stream_appender, level, stream);
 }
 
+/*
+ * File appender state
+ */
+typedef struct
+{
+    FILE*             file;
+    char              path[LOG_PATH_LEN];
+    log_file_config_t config;
+    size_t            used;        // Bytes waiting in the buffer
+    size_t            file_size;   // Bytes written to the current file
+    long long         buffer_time; // Time the oldest buffered entry was added
+    long long         open_time;   // Time the current file was opened
+} log_file_t;
+
+static log_file_t log_files[LOG_MAX_APPENDERS];
+
+static bool
+log_file_open (log_file_t* file, long long now)
+{
+    file->file = fopen(file->path, "a");
+
+    if (NULL == file->file)
+        return false;
+
+    // Batches are written with a single call, stdio buffering would only add
+    // another copy
+    if (NULL != file->config.buffer)
+    {
+        setvbuf(file->file, NULL, _IONBF, 0);
+    }
+
+    fseek(file->file, 0, SEEK_END);
+
+    long size = ftell(file->file);
+
+    file->file_size = (size > 0) ? (size_t)size : 0;
+    file->open_time = now;
+
+    return true;
+}
+
+static void
+log_file_write (log_file_t* file, const char* data, size_t len)
+{
+    if (NULL == file->file || 0 == len)
+        return;
+
+    file->file_size += fwrite(data, 1, len, file->file);
+}
+
+static void
+log_file_flush (void* udata)
+{
+    log_file_t* file = (log_file_t*)udata;
+
+    log_file_write(file, file->config.buffer, file->used);
+    file->used = 0;
+
+    if (NULL != file->file)
+    {
+        fflush(file->file);
+    }
+}
+
+/*
+ * Flushes the buffer if the oldest entry is older than the flush interval.
+ */
+static void
+log_file_flush_expired (log_file_t* file, long long now)
+{
+    if (file->config.flush_interval > 0 && file->used > 0 &&
+        now - file->buffer_time >= file->config.flush_interval * 1000000LL)
+    {
+        log_file_flush(file);
+    }
+}
+
+static void
+log_file_tick (void* udata)
+{
+    log_file_flush_expired((log_file_t*)udata, log_monotonic_ns());
+}
+
+static void
+log_file_close (void* udata)
+{
+    log_file_t* file = (log_file_t*)udata;
+
+    log_file_flush(file);
+
+    if (NULL != file->file)
+    {
+        fclose(file->file);
+        file->file = NULL;
+    }
+}
+
+/*
+ * Closes the current file, shifts the backups (path -> path.1 -> path.2 ...)
+ * and opens a new file.
+ */
+static void
+log_file_rotate (log_file_t* file, long long now)
+{
+    char old_path[LOG_PATH_LEN + 16];
+    char new_path[LOG_PATH_LEN + 16];
+
+    log_file_close(file);
+
+    if (file->config.max_backups > 0)
+    {
+        snprintf(old_path, sizeof(old_path), "%s.%d", file->path,
+                                                      file->config.max_backups);
+        remove(old_path);
+
+        for (int i = file->config.max_backups - 1; i > 0; i--)
+        {
+            snprintf(old_path, sizeof(old_path), "%s.%d", file->path, i);
+            snprintf(new_path, sizeof(new_path), "%s.%d", file->path, i + 1);
+            rename(old_path, new_path);
+        }
+
+        snprintf(new_path, sizeof(new_path), "%s.1", file->path);
+        rename(file->path, new_path);
+    }
+    else
+    {
+        remove(file->path);
+    }
+
+    log_file_open(file, now);
+}
+
+static void
+log_file_appender (const char* entry, void* udata)
+{
+    log_file_t* file = (log_file_t*)udata;
+    log_file_config_t* config = &file->config;
+
+    size_t len = strlen(entry);
+    long long now = log_monotonic_ns();
+
+    // Rotate by size or age
+    size_t pending = file->file_size + file->used;
+
+    if ((config->max_file_size > 0 && pending > 0 &&
+         pending + len > config->max_file_size) ||
+        (config->rotate_interval > 0 &&
+         now - file->open_time >= config->rotate_interval * 1000000000LL))
+    {
+        log_file_rotate(file, now);
+    }
+
+    if (NULL == config->buffer)
+    {
+        log_file_write(file, entry, len);
+        log_file_flush(file);
+        return;
+    }
+
+    // Make room for the entry
+    if (file->used + len > config->buffer_size)
+    {
+        log_file_flush(file);
+    }
+
+    // Entries larger than the buffer are written directly
+    if (len > config->buffer_size)
+    {
+        log_file_write(file, entry, len);
+        return;
+    }
+
+    if (0 == file->used)
+    {
+        file->buffer_time = now;
+    }
+
+    memcpy(config->buffer + file->used, entry, len);
+    file->used += len;
+
+    // Flush by time
+    log_file_flush_expired(file, now);
+}
+
+log_appender_t
+log_add_file (const char* path, log_level_t level,
+                                const log_file_config_t* config)
+{
+    // Path must not be NULL and must fit
+    LOG_ASSERT(NULL != path && strlen(path) < LOG_PATH_LEN);
+
+    // Ensure the buffer and size agree
+    LOG_ASSERT(NULL == config ||
+               (NULL == config->buffer) == (0 == config->buffer_size));
+
+    log_appender_t id = log_add_appender(log_file_appender, level, NULL);
+
+    // No free appender slot
+    if (id < 0)
+        return -1;
+
+    log_file_t* file = &log_files[id];
+
+    memset(file, 0, sizeof(log_file_t));
+    strncpy(file->path, path, LOG_PATH_LEN - 1);
+
+    if (NULL != config)
+    {
+        file->config = *config;
+    }
+
+    if (!log_file_open(file, log_monotonic_ns()))
+    {
+        log_remove_appender(id);
+        return -1;
+    }
+
+    log_appenders[id].udata    = file;
+    log_appenders[id].flush_fp = log_file_flush;
+    log_appenders[id].close_fp = log_file_close;
+    log_appenders[id].tick_fp  = log_file_tick;
+
+    return id;
+}
+
+void
+log_flush (void)
+{
+    // Initialize logger if neccesary
+    log_try_init();
+
+    for (log_appender_t i = 0; i < LOG_MAX_APPENDERS; i++)
+    {
+        log_appender_data_t* appender = &log_appenders[i];
+
+        if (!log_appender_exists(i) || NULL == appender->flush_fp)
+            continue;
+
+        if (NULL != appender->lock_fp)
+        {
+            appender->lock_fp(true, appender->lock_udata);
+        }
+
+        appender->flush_fp(appender->udata);
+
+        if (NULL != appender->lock_fp)
+        {
+            appender->lock_fp(false, appender->lock_udata);
+        }
+    }
+}
+
 void
 log_remove_appender (log_appender_t id)
 {
@@ -590,10 +1574,18 @@ log_remove_appender (log_appender_t id)
     // Ensure appender is registered
     LOG_ASSERT(log_appender_exists(id));
 
+    // Write buffered data and release resources
+    if (NULL != log_appenders[id].close_fp)
+    {
+        log_appenders[id].close_fp(log_appenders[id].udata);
+    }
+
     // Reset appender with given ID
     log_appenders[id].appender_fp = NULL;
 
     log_appender_count--;
+
+    log_update_active_level();
 }
 
 void
@@ -607,6 +1599,8 @@ log_enable_appender (log_appender_t id)
 
     // Enable appender
     log_appenders[id].enabled = true;
+
+    log_update_active_level();
 }
 
 void
@@ -620,6 +1614,8 @@ log_disable_appender (log_appender_t id)
 
     // Disable appender
     log_appenders[id].enabled = false;
+
+    log_update_active_level();
 }
 
 void
@@ -652,6 +1648,8 @@ log_set_level (log_appender_t id, log_level_t level)
 
     // Set the level
     log_appenders[id].log_level = level;
+
+    log_update_active_level();
 }
 
 void
@@ -663,8 +1661,24 @@ log_set_time_fmt (log_appender_t id, const char* fmt)
     // Ensure appender is registered
     LOG_ASSERT(log_appender_exists(id));
 
-    // Copy the time string
-    strncpy(log_appenders[id].time_fmt, fmt, LOG_TIME_FMT_LEN);
+    // Copy the time string, truncating formats that do not fit
+    strncpy(log_appenders[id].time_fmt, fmt, LOG_TIME_FMT_LEN - 1);
+    log_appenders[id].time_fmt[LOG_TIME_FMT_LEN - 1] = '\0';
+}
+
+void
+log_set_time_precision (log_appender_t id, int digits)
+{
+    // Initialize logger if neccesary
+    log_try_init();
+
+    // Ensure appender is registered
+    LOG_ASSERT(log_appender_exists(id));
+
+    // Ensure the number of digits is valid
+    LOG_ASSERT(digits >= 0 && digits <= 9);
+
+    log_appenders[id].time_precision = digits;
 }
 
 void
@@ -732,161 +1746,1845 @@ log_display_function (log_appender_t id, bool enabled)
     log_appenders[id].func = enabled;
 }
 
-/*
- * Formats the current time as as string.
- */
-static char*
-log_time_str (const char* time_fmt, char* str, size_t len)
+void
+log_display_context (log_appender_t id, bool enabled)
 {
-    time_t now = time(0);
-    size_t ret = strftime(str, len, time_fmt, localtime(&now));
+    // Initialize logger if neccesary
+    log_try_init();
 
-    LOG_ASSERT(ret > 0);
+    // Ensure appender is registered
+    LOG_ASSERT(log_appender_exists(id));
 
-    return str;
+    // Turn context reporting on
+    log_appenders[id].context = enabled;
 }
 
-static void
-log_append_timestamp (char* entry_str, const char* time_fmt)
+void
+log_set_format (log_appender_t id, log_format_t format)
 {
-    char time_str[LOG_TIMESTAMP_LEN + 1];
-    char tmp_str[LOG_TIMESTAMP_LEN];
+    // Initialize logger if neccesary
+    log_try_init();
+
+    // Ensure appender is registered
+    LOG_ASSERT(log_appender_exists(id));
 
-    snprintf(time_str, sizeof(time_str), "%s ",
-             log_time_str(time_fmt, tmp_str, sizeof(tmp_str)));
+    // Ensure format is valid
+    LOG_ASSERT(format >= LOG_FORMAT_TEXT && format <= LOG_FORMAT_LOGFMT);
 
-    strncat(entry_str, time_str, LOG_TIMESTAMP_LEN);
+    log_appenders[id].format = format;
+}
+
+unsigned
+log_thread_id (void)
+{
+    if (0 == log_context.thread)
+    {
+        log_context.thread = LOG_ATOMIC_INC(&log_thread_count);
+    }
+
+    return log_context.thread;
+}
+
+void
+log_set_context (const char* key, long long value)
+{
+    // Key must not be NULL
+    LOG_ASSERT(NULL != key);
+
+    // Update an existing field
+    for (unsigned i = 0; i < log_context.count; i++)
+    {
+        if (key == log_context.keys[i] || 0 == strcmp(key, log_context.keys[i]))
+        {
+            log_context.values[i] = value;
+            return;
+        }
+    }
+
+    // Check if there is space for a new field
+    LOG_ASSERT(log_context.count < LOG_MAX_CONTEXT);
+
+    if (log_context.count >= LOG_MAX_CONTEXT)
+        return;
+
+    log_context.keys[log_context.count]   = key;
+    log_context.values[log_context.count] = value;
+    log_context.count++;
+}
+
+void
+log_clear_context (void)
+{
+    log_context.count = 0;
+}
+
+/*
+ * Copies the calling thread's context into a record.
+ */
+static void
+log_capture_context (log_context_t* context)
+{
+    log_thread_id();
+
+    context->thread = log_context.thread;
+    context->count  = log_context.count;
+
+    for (unsigned i = 0; i < log_context.count; i++)
+    {
+        context->keys[i]   = log_context.keys[i];
+        context->values[i] = log_context.values[i];
+    }
+}
+
+/*
+ * Entry components shared by the appenders. Each component is formatted the
+ * first time an appender requests it and is reused by the other appenders.
+ * Variants that depend on appender settings (colors) are cached separately. A
+ * length of zero means the component has not been formatted. Timestamps are
+ * cached per thread instead (see log_time_cache).
+ */
+typedef struct
+{
+    const log_record_t* record;
+    size_t              msg_len;
+    char                level[2][LOG_LEVEL_LEN];
+    size_t              level_len[2];
+    char                file[LOG_FILE_LEN];
+    size_t              file_len;
+    char                func[2][LOG_FUNC_LEN];
+    size_t              func_len[2];
+    char                context[2][LOG_CONTEXT_LEN];
+    size_t              context_len[2];
+} log_components_t;
+
+/*
+ * Clamps an snprintf result to the number of characters actually written.
+ */
+static size_t
+log_clamp_len (int ret, size_t size)
+{
+    if (ret < 0)
+        return 0;
+
+    return ((size_t)ret < size) ? (size_t)ret : size - 1;
+}
+
+/*
+ * Timestamp formatted to the second, cached per thread and appender. It is
+ * only reformatted when the second (or the time format) changes.
+ */
+typedef struct
+{
+    time_t time;
+    char   time_fmt[LOG_TIME_FMT_LEN];
+    char   str[LOG_TIMESTAMP_LEN];
+    size_t len; // Zero if nothing is cached
+} log_time_cache_t;
+
+static LOG_THREAD_LOCAL log_time_cache_t log_time_cache[LOG_MAX_APPENDERS];
+
+/*
+ * Converts a time to local calendar time without relying on shared state when
+ * the platform allows it.
+ */
+static bool
+log_localtime (time_t time, struct tm* tm)
+{
+#if defined(_MSC_VER)
+    return 0 == localtime_s(tm, &time);
+#elif defined(LOG_POSIX_CLOCK)
+    return NULL != localtime_r(&time, tm);
+#else
+    struct tm* ptr = localtime(&time);
+
+    if (NULL == ptr)
+        return false;
+
+    *tm = *ptr;
+    return true;
+#endif
+}
+
+/*
+ * Formats the timestamp for the given appender, reserving space for the
+ * sub-second digits and the trailing space.
+ */
+static size_t
+log_format_timestamp (char* str, log_appender_t id, time_t time, long nsec)
+{
+    const log_appender_data_t* appender = &log_appenders[id];
+    log_time_cache_t* cache = &log_time_cache[id];
+
+    if (0 == cache->len || time != cache->time ||
+        0 != strncmp(cache->time_fmt, appender->time_fmt, LOG_TIME_FMT_LEN))
+    {
+        struct tm tm;
+        size_t ret = 0;
+
+        // Reserve space for a '.', nine digits and the trailing space
+        if (log_localtime(time, &tm))
+            ret = strftime(cache->str, LOG_TIMESTAMP_LEN - 11,
+                           appender->time_fmt, &tm);
+
+        LOG_ASSERT(ret > 0);
+
+        cache->time = time;
+        cache->len  = ret;
+
+        strncpy(cache->time_fmt, appender->time_fmt, LOG_TIME_FMT_LEN - 1);
+        cache->time_fmt[LOG_TIME_FMT_LEN - 1] = '\0';
+
+        // An empty timestamp is not cached
+        if (0 == ret)
+            return 0;
+    }
+
+    size_t len = cache->len;
+    memcpy(str, cache->str, len);
+
+    // Append the sub-second digits
+    if (appender->time_precision > 0)
+    {
+        int digits = appender->time_precision;
+
+        for (int i = digits; i < 9; i++)
+            nsec /= 10;
+
+        str[len] = '.';
+
+        for (int i = digits; i > 0; i--)
+        {
+            str[len + i] = (char)('0' + nsec % 10);
+            nsec /= 10;
+        }
+
+        len += (size_t)digits + 1;
+    }
+
+    str[len++] = ' ';
+
+    return len;
+}
+
+static size_t
+log_format_level (char* str, size_t len, log_level_t level, bool colors)
+{
+    int ret;
+
+    if (colors)
+    {
+        ret = snprintf(str, len, "%c%s%s %c%s",
+                       LOG_TERM_CODE, log_level_color[level],
+                       log_level_str_formatted[level],
+                       LOG_TERM_CODE, LOG_TERM_RESET);
+    }
+    else
+    {
+        ret = snprintf(str, len, "%s ", log_level_str_formatted[level]);
+    }
+
+    return log_clamp_len(ret, len);
+}
+
+static size_t
+log_format_file (char* str, size_t len, const char* file, unsigned line)
+{
+    int ret = snprintf(str, len, "[%s:%u] ", file, line);
+    return log_clamp_len(ret, len);
+}
+
+static size_t
+log_format_func (char* str, size_t len, const char* func, bool colors)
+{
+    int ret;
+
+    if (colors)
+    {
+        ret = snprintf(str, len, "%c%s[%s] %c%s",
+                       LOG_TERM_CODE, LOG_TERM_GRAY,
+                       func,
+                       LOG_TERM_CODE, LOG_TERM_RESET);
+    }
+    else
+    {
+        ret = snprintf(str, len, "[%s] ", func);
+    }
+
+    return log_clamp_len(ret, len);
+}
+
+static size_t
+log_format_context (char* str, size_t len, const log_context_t* context,
+                                           bool colors)
+{
+    size_t ret = 0;
+
+    #define LOG_CONTEXT_PRINT(...) \
+        ret += log_clamp_len(snprintf(str + ret, len - ret, __VA_ARGS__), len - ret)
+
+    if (colors)
+    {
+        LOG_CONTEXT_PRINT("%c%s", LOG_TERM_CODE, LOG_TERM_GRAY);
+    }
+
+    LOG_CONTEXT_PRINT("[thread=%u", context->thread);
+
+    for (unsigned i = 0; i < context->count; i++)
+    {
+        LOG_CONTEXT_PRINT(" %s=%lld", context->keys[i], context->values[i]);
+    }
+
+    LOG_CONTEXT_PRINT("] ");
+
+    if (colors)
+    {
+        LOG_CONTEXT_PRINT("%c%s", LOG_TERM_CODE, LOG_TERM_RESET);
+    }
+
+    #undef LOG_CONTEXT_PRINT
+
+    return ret;
+}
+
+/*
+ * Appends a string of known length to the entry and returns the new length.
+ */
+static size_t
+log_append (char* entry_str, size_t entry_len, const char* str, size_t len)
+{
+    memcpy(entry_str + entry_len, str, len);
+    return entry_len + len;
+}
+
+/*
+ * Bounded writer used to build structured entries in place. Writes that do not
+ * fit are dropped, space for the end of the entry is reserved by the caller.
+ */
+typedef struct
+{
+    char*  str;
+    size_t len;
+    size_t cap;
+    bool   overflow; // Set when a write is dropped
+} log_writer_t;
+
+static void
+log_put (log_writer_t* writer, const char* str, size_t len)
+{
+    if (writer->len + len > writer->cap)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->str + writer->len, str, len);
+    writer->len += len;
 }
 
 static void
-log_append_level (char* entry_str, log_level_t level, bool colors)
+log_put_int (log_writer_t* writer, long long value)
+{
+    char str[32];
+    int ret = snprintf(str, sizeof(str), "%lld", value);
+    log_put(writer, str, log_clamp_len(ret, sizeof(str)));
+}
+
+/*
+ * Returns true if a logfmt value must be quoted.
+ */
+static bool
+log_logfmt_needs_quotes (const char* str)
+{
+    if ('\0' == *str)
+        return true;
+
+    for (; *str; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+
+        if (c <= ' ' || '=' == c || '"' == c || '\\' == c || 0x7F == c)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Writes a string value, quoted and escaped as required by the format. Escape
+ * sequences are never split.
+ */
+static void
+log_put_value (log_writer_t* writer, const char* str, log_format_t format)
+{
+    bool quote = (LOG_FORMAT_JSON == format) || log_logfmt_needs_quotes(str);
+
+    // Reserve space for the closing quote
+    if (quote)
+    {
+        if (writer->len + 2 > writer->cap)
+        {
+            writer->overflow = true;
+            return;
+        }
+
+        log_put(writer, "\"", 1);
+        writer->cap--;
+    }
+
+    for (; *str; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+        char escape[8];
+        size_t len = 2;
+
+        escape[0] = '\\';
+
+        switch (c)
+        {
+            case '"':  escape[1] = '"';  break;
+            case '\\': escape[1] = '\\'; break;
+            case '\n': escape[1] = 'n';  break;
+            case '\r': escape[1] = 'r';  break;
+            case '\t': escape[1] = 't';  break;
+
+            default:
+                if (c < 0x20 || 0x7F == c)
+                {
+                    len = (size_t)snprintf(escape, sizeof(escape), "\\u%04x", c);
+                }
+                else
+                {
+                    escape[0] = (char)c;
+                    len = 1;
+                }
+                break;
+        }
+
+        // Truncate rather than split an escape sequence
+        if (writer->len + len > writer->cap)
+            break;
+
+        log_put(writer, escape, len);
+    }
+
+    if (quote)
+    {
+        writer->cap++;
+        log_put(writer, "\"", 1);
+    }
+}
+
+/*
+ * Writes a logfmt key. Keys cannot be quoted, so characters that would end the
+ * key or require quotes are replaced with underscores.
+ */
+static void
+log_put_logfmt_key (log_writer_t* writer, const char* key)
+{
+    if ('\0' == *key)
+    {
+        log_put(writer, "_", 1);
+        return;
+    }
+
+    for (; *key; key++)
+    {
+        unsigned char c = (unsigned char)*key;
+        char ch = (char)c;
+
+        if (c <= ' ' || '=' == c || '"' == c || '\\' == c || 0x7F == c)
+            ch = '_';
+
+        log_put(writer, &ch, 1);
+    }
+}
+
+/*
+ * Writes the key of a field, preceded by a separator unless it is the first.
+ * Keys are escaped since context keys are supplied by the user.
+ */
+static void
+log_put_key (log_writer_t* writer, const char* key, log_format_t format,
+                                                    bool first)
+{
+    if (LOG_FORMAT_JSON == format)
+    {
+        log_put(writer, first ? "{" : ",", 1);
+        log_put_value(writer, key, format);
+        log_put(writer, ":", 1);
+    }
+    else
+    {
+        if (!first)
+            log_put(writer, " ", 1);
+
+        log_put_logfmt_key(writer, key);
+        log_put(writer, "=", 1);
+    }
+}
+
+/*
+ * Writes an integer field. Fields that do not fit are dropped entirely, so that
+ * a key is never left without a value.
+ */
+static void
+log_put_int_field (log_writer_t* writer, const char* key, long long value,
+                                         log_format_t format)
+{
+    size_t len = writer->len;
+
+    writer->overflow = false;
+
+    log_put_key(writer, key, format, false);
+    log_put_int(writer, value);
+
+    if (writer->overflow)
+        writer->len = len;
+}
+
+/*
+ * Writes a string field. The value may be truncated, but the field is dropped
+ * if not even the key and an empty value fit.
+ */
+static void
+log_put_str_field (log_writer_t* writer, const char* key, const char* value,
+                                         log_format_t format)
+{
+    size_t len = writer->len;
+
+    writer->overflow = false;
+
+    log_put_key(writer, key, format, false);
+    log_put_value(writer, value, format);
+
+    if (writer->overflow)
+        writer->len = len;
+}
+
+/*
+ * Writes a structured entry directly into the entry buffer.
+ */
+static size_t
+log_assemble_structured (char* entry_str, const log_record_t* record,
+                                          log_format_t format)
+{
+    log_writer_t writer;
+
+    // Reserve space for the closing brace, line break and null character
+    writer.str = entry_str;
+    writer.len = 0;
+    writer.cap = LOG_ENTRY_LEN - 2;
+    writer.overflow = false;
+
+    // The first field always fits
+    log_put_key(&writer, "level", format, true);
+    log_put_value(&writer, log_level_str[record->level], format);
+
+    log_put_int_field(&writer, "ts_ns",
+                      (long long)record->time * 1000000000LL + record->nsec,
+                      format);
+
+    log_put_str_field(&writer, "file", record->file, format);
+    log_put_int_field(&writer, "line", (long long)record->line, format);
+    log_put_str_field(&writer, "func", record->func, format);
+    log_put_int_field(&writer, "thread", (long long)record->context.thread,
+                      format);
+
+    for (unsigned i = 0; i < record->context.count; i++)
+    {
+        log_put_int_field(&writer, record->context.keys[i],
+                          record->context.values[i], format);
+    }
+
+    log_put_str_field(&writer, "msg", record->msg, format);
+
+    writer.cap = LOG_ENTRY_LEN;
+
+    if (LOG_FORMAT_JSON == format)
+        log_put(&writer, "}", 1);
+
+    log_put(&writer, "\n", 1);
+
+    entry_str[writer.len] = '\0';
+
+    return writer.len;
+}
+
+/*
+ * Assembles the entry for the given appender from the shared components.
+ */
+static size_t
+log_assemble (char* entry_str, log_appender_t id,
+                               log_components_t* components)
 {
-    char level_str[LOG_LEVEL_LEN];
+    const log_record_t* record = components->record;
+    log_appender_data_t* appender = &log_appenders[id];
+    size_t len = 0;
+
+    if (LOG_FORMAT_TEXT != appender->format)
+    {
+        return log_assemble_structured(entry_str, record, appender->format);
+    }
+
+    // Append a timestamp
+    if (appender->timestamp)
+    {
+        len = log_format_timestamp(entry_str, id, record->time, record->nsec);
+    }
+
+    // Append the logger level
+    if (appender->level)
+    {
+        int i = appender->colors ? 1 : 0;
+
+        if (0 == components->level_len[i])
+        {
+            components->level_len[i] =
+                log_format_level(components->level[i],
+                                 sizeof(components->level[i]),
+                                 record->level, appender->colors);
+        }
+
+        len = log_append(entry_str, len, components->level[i],
+                                         components->level_len[i]);
+    }
+
+    // Append the filename/line number
+    if (appender->file)
+    {
+        if (0 == components->file_len)
+        {
+            components->file_len =
+                log_format_file(components->file, sizeof(components->file),
+                                record->file, record->line);
+        }
+
+        len = log_append(entry_str, len, components->file,
+                                         components->file_len);
+    }
+
+    // Append the function name
+    if (appender->func)
+    {
+        int i = appender->colors ? 1 : 0;
+
+        if (0 == components->func_len[i])
+        {
+            components->func_len[i] =
+                log_format_func(components->func[i],
+                                sizeof(components->func[i]),
+                                record->func, appender->colors);
+        }
+
+        len = log_append(entry_str, len, components->func[i],
+                                         components->func_len[i]);
+    }
+
+    // Append the thread context
+    if (appender->context)
+    {
+        int i = appender->colors ? 1 : 0;
+
+        if (0 == components->context_len[i])
+        {
+            components->context_len[i] =
+                log_format_context(components->context[i],
+                                   sizeof(components->context[i]),
+                                   &record->context, appender->colors);
+        }
+
+        len = log_append(entry_str, len, components->context[i],
+                                         components->context_len[i]);
+    }
+
+    // Append the log message
+    len = log_append(entry_str, len, record->msg, components->msg_len);
+    len = log_append(entry_str, len, "\n", 1);
+
+    entry_str[len] = '\0';
+
+    return len;
+}
+
+/*
+ * Assembles the entry for each appender and writes it. Components common to
+ * several appenders are only formatted once.
+ */
+static void
+log_dispatch (const log_record_t* record)
+{
+    log_components_t components;
+
+    components.record        = record;
+    components.msg_len       = strlen(record->msg);
+    components.level_len[0]  = components.level_len[1] = 0;
+    components.file_len      = 0;
+    components.func_len[0]   = components.func_len[1]  = 0;
+    components.context_len[0] = components.context_len[1] = 0;
+
+    for (log_appender_t i = 0; i < LOG_MAX_APPENDERS; i++)
+    {
+        log_appender_data_t* appender = &log_appenders[i];
+
+        if (!log_appender_enabled(i))
+            continue;
+
+        if (log_appenders[i].log_level <= record->level)
+        {
+            char entry_str[LOG_ENTRY_LEN + 1]; // Ensure there is space for
+                                              // null char
+
+            log_assemble(entry_str, i, &components);
+
+            // Locks the appender
+            if (NULL != appender->lock_fp)
+            {
+                appender->lock_fp(true, appender->lock_udata);
+            }
+
+            appender->appender_fp(entry_str, appender->udata);
+
+            // Make sure fatal errors reach their destination
+            if (LOG_LEVEL_FATAL == record->level && NULL != appender->flush_fp)
+            {
+                appender->flush_fp(appender->udata);
+            }
+
+            // Unlocks the appender
+            if (NULL != appender->lock_fp)
+            {
+                appender->lock_fp(false, appender->lock_udata);
+            }
+        }
+    }
+}
+
+/*
+ * Claims a free queue cell. Returns NULL if the queue is full and the policy
+ * is to drop entries.
+ */
+static log_queue_cell_t*
+log_queue_claim (unsigned* pos)
+{
+    unsigned tail  = LOG_ATOMIC_LOAD(&log_queue_tail);
+    unsigned spins = 0;
+
+    for (;;)
+    {
+        log_queue_cell_t* cell = &log_queue[tail % LOG_QUEUE_SIZE];
+
+        int diff = (int)(LOG_ATOMIC_LOAD(&cell->seq) - tail);
+
+        if (0 == diff)
+        {
+            // The cell is free, attempt to claim it (on failure the tail is
+            // reloaded)
+            if (LOG_ATOMIC_CAS(&log_queue_tail, &tail, tail + 1))
+            {
+                *pos = tail;
+                return cell;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The queue is full
+            if (LOG_ASYNC_DROP == log_async_policy)
+            {
+                LOG_ATOMIC_INC(&log_dropped);
+                return NULL;
+            }
+
+            // Wait for log_drain, briefly spinning before giving up the CPU
+            if (spins < LOG_SPIN_COUNT)
+            {
+                LOG_CPU_PAUSE();
+                spins++;
+            }
+            else
+            {
+                LOG_YIELD();
+            }
+
+            tail = LOG_ATOMIC_LOAD(&log_queue_tail);
+        }
+        else
+        {
+            // Another producer claimed the cell first
+            tail = LOG_ATOMIC_LOAD(&log_queue_tail);
+        }
+    }
+}
+
+void
+log_enable_async (log_async_policy_t policy)
+{
+#ifdef LOG_NO_ATOMICS
+    // Atomic operations are not available on this compiler
+    (void)policy;
+    LOG_ASSERT(false);
+#else
+    // Ensure the queue size is a power of two
+    LOG_ASSERT(0 == (LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)));
+
+    if (LOG_ATOMIC_LOAD(&log_async))
+    {
+        log_async_policy = policy;
+        return;
+    }
+
+    // Mark every cell as free
+    for (unsigned i = 0; i < LOG_QUEUE_SIZE; i++)
+    {
+        log_queue[i].seq = i;
+    }
+
+    log_queue_head   = 0;
+    log_queue_tail   = 0;
+    log_async_policy = policy;
+
+    LOG_ATOMIC_STORE(&log_async, 1u);
+#endif
+}
+
+void
+log_disable_async (void)
+{
+    LOG_ATOMIC_STORE(&log_async, 0u);
+
+    // Dispatch remaining entries
+    log_drain();
+}
+
+size_t
+log_drain (void)
+{
+    size_t count = 0;
+
+    for (;;)
+    {
+        log_queue_cell_t* cell = &log_queue[log_queue_head % LOG_QUEUE_SIZE];
+
+        // Stop at the first cell that has not been published
+        if (LOG_ATOMIC_LOAD(&cell->seq) != log_queue_head + 1)
+            break;
+
+        log_dispatch(&cell->record);
+
+        // Release the cell for the next pass around the queue
+        LOG_ATOMIC_STORE(&cell->seq, log_queue_head + LOG_QUEUE_SIZE);
+
+        log_queue_head++;
+        count++;
+    }
+
+    // Flush buffers that have been idle for too long
+    for (log_appender_t i = 0; i < LOG_MAX_APPENDERS; i++)
+    {
+        log_appender_data_t* appender = &log_appenders[i];
+
+        if (!log_appender_exists(i) || NULL == appender->tick_fp)
+            continue;
+
+        if (NULL != appender->lock_fp)
+        {
+            appender->lock_fp(true, appender->lock_udata);
+        }
+
+        appender->tick_fp(appender->udata);
+
+        if (NULL != appender->lock_fp)
+        {
+            appender->lock_fp(false, appender->lock_udata);
+        }
+    }
+
+    return count;
+}
+
+size_t
+log_dropped_count (void)
+{
+    return LOG_ATOMIC_LOAD(&log_dropped);
+}
+
+/*
+ * Rate limiting
+ *
+ * Each call site is assigned a slot in a fixed size hash table. Slots are
+ * claimed by swapping in the call site hash with a CAS, so lookups never take
+ * a lock. The token bucket is implemented with the generic cell rate
+ * algorithm: the slot stores the theoretical arrival time (TAT) of the next
+ * message, which advances by the interval for every message allowed. A message
+ * is allowed as long as the TAT is no more than the burst window ahead of the
+ * current time.
+ */
+typedef struct
+{
+    unsigned  key;        // Call site hash, zero if the slot is free
+    unsigned  suppressed; // Messages suppressed since the last one allowed
+    long long tat;        // Theoretical arrival time in nanoseconds
+} log_rate_slot_t;
+
+static log_rate_slot_t log_rate_slots[LOG_RATE_SITES];
+static long long       log_rate_interval = 0; // Nanoseconds per message
+static long long       log_rate_window   = 0; // Burst tolerance
+
+void
+log_set_rate_limit (unsigned rate, unsigned burst)
+{
+    // Ensure the bucket can hold at least one message
+    LOG_ASSERT(0 == rate || burst > 0);
+
+    if (0 == rate || 0 == burst)
+    {
+        log_rate_interval = 0;
+        return;
+    }
+
+    log_rate_interval = 1000000000LL / rate;
+    log_rate_window   = log_rate_interval * (long long)(burst - 1);
+}
+
+/*
+ * Hashes a call site. Never returns zero.
+ */
+static unsigned
+log_hash_site (const char* file, unsigned line)
+{
+    uint64_t hash = (uint64_t)(uintptr_t)file;
+
+    hash ^= (uint64_t)line * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+
+    return (0 != (unsigned)hash) ? (unsigned)hash : 1u;
+}
+
+/*
+ * Returns true if the call site may log at the given time. If so, the number
+ * of messages suppressed since the previous one is returned in `suppressed`.
+ */
+static bool
+log_rate_check (const char* file, unsigned line, long long now,
+                unsigned* suppressed)
+{
+    *suppressed = 0;
+
+    if (0 == log_rate_interval)
+        return true;
+
+    unsigned key = log_hash_site(file, line);
+    log_rate_slot_t* slot = NULL;
+
+    // Find or claim the slot of the call site
+    for (unsigned i = 0; i < LOG_RATE_SITES; i++)
+    {
+        log_rate_slot_t* candidate = &log_rate_slots[(key + i) % LOG_RATE_SITES];
+
+        unsigned current = LOG_ATOMIC_LOAD(&candidate->key);
+
+        if (0 == current && LOG_ATOMIC_CAS(&candidate->key, &current, key))
+            current = key;
+
+        if (current == key)
+        {
+            slot = candidate;
+            break;
+        }
+    }
+
+    // The table is full, so this call site is not limited
+    if (NULL == slot)
+        return true;
+
+    long long tat = LOG_ATOMIC_LOAD64(&slot->tat);
+
+    for (;;)
+    {
+        long long start = (tat > now) ? tat : now;
+
+        if (start - now > log_rate_window)
+        {
+            LOG_ATOMIC_INC(&slot->suppressed);
+            return false;
+        }
+
+        // On failure the TAT is reloaded
+        if (LOG_ATOMIC_CAS64(&slot->tat, &tat, start + log_rate_interval))
+            break;
+    }
+
+    *suppressed = LOG_ATOMIC_XCHG(&slot->suppressed, 0u);
+
+    return true;
+}
+
+/*
+ * Returns a record to fill in. In asynchronous mode this is a cell in the
+ * queue, otherwise it is the local record supplied by the caller. Returns NULL
+ * if the queue is full and the entry must be dropped.
+ */
+static log_record_t*
+log_begin_record (log_record_t* local, log_queue_cell_t** cell, unsigned* pos)
+{
+    *cell = NULL;
+
+    if (!LOG_ATOMIC_LOAD(&log_async))
+        return local;
+
+    *cell = log_queue_claim(pos);
+
+    return (NULL != *cell) ? &(*cell)->record : NULL;
+}
+
+/*
+ * Publishes the record to the consumer or dispatches it immediately.
+ */
+static void
+log_end_record (log_record_t* record, log_queue_cell_t* cell, unsigned pos)
+{
+    if (NULL != cell)
+    {
+        LOG_ATOMIC_STORE(&cell->seq, pos + 1);
+    }
+    else
+    {
+        log_dispatch(record);
+    }
+}
+
+/*
+ * Writes an entry using a va_list.
+ */
+static void
+log_vwrite (log_level_t level, const char* file, unsigned line,
+                               const char* func, time_t time, long nsec,
+                               const char* fmt, va_list args)
+{
+    log_queue_cell_t* cell = NULL;
+    log_record_t local_record;
+    unsigned pos = 0;
+
+    // In asynchronous mode the record is written directly into the queue
+    log_record_t* record = log_begin_record(&local_record, &cell, &pos);
+
+    if (NULL == record)
+        return;
+
+    record->level = level;
+    record->file  = file;
+    record->line  = line;
+    record->func  = func;
+    record->time  = time;
+    record->nsec  = nsec;
+
+    log_capture_context(&record->context);
+
+    // Format the log message
+    vsnprintf(record->msg, sizeof(record->msg), fmt, args);
+
+    log_end_record(record, cell, pos);
+}
+
+#define LOG_SUPPRESSED_FMT "Suppressed %u similar messages"
+
+static void
+log_write_suppressed (bool deferred, log_level_t level, const char* file,
+                                     unsigned line, const char* func,
+                                     time_t time, long nsec,
+                                     const char* fmt, ...);
+
+void
+log_write (log_level_t level, const char* file, unsigned line,
+                              const char* func, const char* fmt, ...)
+{
+    // Ensure logger is initialized
+    log_try_init();
+
+    // Only write entry if an enabled appender accepts the level (this also
+    // covers the cases where there are no appenders or the logger is disabled)
+    if (level < PICO_LOG_ACTIVE_LEVEL())
+    {
+        return;
+    }
+
+    // Ensure valid log level
+    LOG_ASSERT(level < LOG_LEVEL_COUNT);
+
+    long long now = log_now();
+    unsigned suppressed;
 
-    if (colors)
+    // Drop the entry if the call site exceeded its rate limit
+    if (!log_rate_check(file, line, now, &suppressed))
     {
-        snprintf(level_str, sizeof(level_str), "%c%s%s %c%s",
-        LOG_TERM_CODE, log_level_color[level],
-        log_level_str_formatted[level],
-        LOG_TERM_CODE, LOG_TERM_RESET);
+        return;
     }
-    else
+
+    time_t time;
+    long nsec;
+
+    log_split_time(now, &time, &nsec);
+
+    if (suppressed > 0)
     {
-        snprintf(level_str, sizeof(level_str), "%s ", log_level_str_formatted[level]);
+        log_write_suppressed(false, level, file, line, func, time, nsec,
+                             LOG_SUPPRESSED_FMT, suppressed);
     }
 
-    strncat(entry_str, level_str, LOG_LEVEL_LEN);
+    va_list args;
+    va_start(args, fmt);
+    log_vwrite(level, file, line, func, time, nsec, fmt, args);
+    va_end(args);
 }
 
-static void
-log_append_file (char* entry_str, const char* file, unsigned line)
+/*
+ * Deferred logging
+ *
+ * A record consists of a header followed by the arguments. Every value is
+ * padded to a multiple of LOG_DEFERRED_ALIGN bytes and accessed with memcpy,
+ * so the buffer does not need any particular alignment. Integers are widened
+ * to intmax_t/uintmax_t (after applying the hh/h conversions) and printed
+ * using the j length modifier. Strings are stored as a length followed by
+ * the characters and a null terminator. The thread context fields (key pointer
+ * and value pairs) are stored between the header and the arguments.
+ */
+
+#define LOG_DEFERRED_ALIGN       8
+#define LOG_DEFERRED_PAD(size)   (((size) + LOG_DEFERRED_ALIGN - 1) & \
+                                  ~(size_t)(LOG_DEFERRED_ALIGN - 1))
+#define LOG_DEFERRED_SPEC_LEN    32
+
+typedef struct
 {
-    char file_str[LOG_FILE_LEN];
-    snprintf(file_str, sizeof(file_str), "[%s:%u] ", file, line);
-    strncat(entry_str, file_str, LOG_FILE_LEN);
-}
+    const char* fmt;
+    const char* file;
+    const char* func;
+    time_t      time;
+    long        nsec;
+    unsigned    line;
+    unsigned    level;
+    unsigned    thread;
+    unsigned    context_count;
+    size_t      size;  // Total size of the record, including the header
+} log_deferred_header_t;
 
-static void
-log_append_func (char* entry_str, const char* func, bool colors)
+typedef struct
 {
-   char func_str[LOG_FUNC_LEN];
+    unsigned char* data;
+    size_t         size;
+    size_t         used;
+} log_deferred_buffer_t;
 
-    if (colors)
+static LOG_THREAD_LOCAL log_deferred_buffer_t log_deferred_buffer;
+
+/*
+ * Length modifiers of a conversion specification.
+ */
+typedef enum
+{
+    LOG_LENGTH_NONE,
+    LOG_LENGTH_HH,
+    LOG_LENGTH_H,
+    LOG_LENGTH_L,
+    LOG_LENGTH_LL,
+    LOG_LENGTH_J,
+    LOG_LENGTH_Z,
+    LOG_LENGTH_T,
+    LOG_LENGTH_LD
+} log_length_t;
+
+/*
+ * A parsed printf conversion specification (e.g. "%-8.3lf").
+ */
+typedef struct
+{
+    const char*  start;       // Points to the '%'
+    size_t       prefix_len;  // Length of '%', flags, width and precision
+    bool         star_width;
+    bool         star_precision;
+    int          precision;   // Negative if not specified
+    log_length_t length;
+    char         conv;
+} log_spec_t;
+
+/*
+ * Parses the conversion specification starting at fmt (which points to '%')
+ * and returns a pointer to the character following it.
+ */
+static const char*
+log_parse_spec (const char* fmt, log_spec_t* spec)
+{
+    const char* ptr = fmt + 1;
+
+    spec->start          = fmt;
+    spec->star_width     = false;
+    spec->star_precision = false;
+    spec->precision      = -1;
+    spec->length         = LOG_LENGTH_NONE;
+
+    // Flags
+    while (*ptr && strchr("-+ #0", *ptr))
+        ptr++;
+
+    // Width
+    if ('*' == *ptr)
     {
-        snprintf(func_str, sizeof(func_str), "%c%s[%s] %c%s",
-                 LOG_TERM_CODE, LOG_TERM_GRAY,
-                 func,
-                 LOG_TERM_CODE, LOG_TERM_RESET);
+        spec->star_width = true;
+        ptr++;
     }
-    else
+
+    while (*ptr >= '0' && *ptr <= '9')
+        ptr++;
+
+    // Precision
+    if ('.' == *ptr)
+    {
+        ptr++;
+
+        if ('*' == *ptr)
+        {
+            spec->star_precision = true;
+            ptr++;
+        }
+
+        spec->precision = 0;
+
+        while (*ptr >= '0' && *ptr <= '9')
+            spec->precision = spec->precision * 10 + (*ptr++ - '0');
+    }
+
+    spec->prefix_len = (size_t)(ptr - fmt);
+
+    // Length modifiers
+    switch (*ptr)
     {
-        snprintf(func_str, sizeof(func_str), "[%s] ", func);
+        case 'h':
+            ptr++;
+            spec->length = LOG_LENGTH_H;
+
+            if ('h' == *ptr)
+            {
+                ptr++;
+                spec->length = LOG_LENGTH_HH;
+            }
+            break;
+
+        case 'l':
+            ptr++;
+            spec->length = LOG_LENGTH_L;
+
+            if ('l' == *ptr)
+            {
+                ptr++;
+                spec->length = LOG_LENGTH_LL;
+            }
+            break;
+
+        case 'j': ptr++; spec->length = LOG_LENGTH_J;  break;
+        case 'z': ptr++; spec->length = LOG_LENGTH_Z;  break;
+        case 't': ptr++; spec->length = LOG_LENGTH_T;  break;
+        case 'L': ptr++; spec->length = LOG_LENGTH_LD; break;
+        default: break;
     }
 
-    strncat(entry_str, func_str, LOG_FUNC_LEN);
+    spec->conv = *ptr;
+
+    return ('\0' != *ptr) ? ptr + 1 : ptr;
 }
 
-void
-log_write (log_level_t level, const char* file, unsigned line,
-                              const char* func, const char* fmt, ...)
+/*
+ * Appends a value to a deferred record. Returns false if there is not enough
+ * space.
+ */
+static bool
+log_deferred_put (unsigned char* data, size_t size, size_t* offset,
+                  const void* value, size_t value_size)
 {
-    // Ensure logger is initialized
-    log_try_init();
+    size_t padded = LOG_DEFERRED_PAD(value_size);
+
+    if (*offset + padded > size)
+        return false;
 
-    // Only write entry if there are registered appenders and the logger is
-    // enabled
-    if (0 == log_appender_count || !log_enabled)
+    memcpy(data + *offset, value, value_size);
+    *offset += padded;
+
+    return true;
+}
+
+/*
+ * Reads a value from a deferred record. Returns false if the record is too
+ * short.
+ */
+static bool
+log_deferred_get (const unsigned char* data, size_t size, size_t* offset,
+                  void* value, size_t value_size)
+{
+    size_t padded = LOG_DEFERRED_PAD(value_size);
+
+    if (*offset + padded > size)
+        return false;
+
+    memcpy(value, data + *offset, value_size);
+    *offset += padded;
+
+    return true;
+}
+
+/*
+ * Encodes a record. Returns its size or zero if it does not fit.
+ */
+static size_t
+log_deferred_encode (unsigned char* data, size_t size,
+                     log_deferred_header_t* header, va_list args)
+{
+    size_t offset = LOG_DEFERRED_PAD(sizeof(log_deferred_header_t));
+
+    if (offset > size)
+        return 0;
+
+    // Store the context of the calling thread
+    for (unsigned i = 0; i < header->context_count; i++)
     {
-        return;
+        if (!log_deferred_put(data, size, &offset, &log_context.keys[i],
+                              sizeof(log_context.keys[i])) ||
+            !log_deferred_put(data, size, &offset, &log_context.values[i],
+                              sizeof(log_context.values[i])))
+            return 0;
     }
 
-    // Ensure valid log level
-    LOG_ASSERT(level < LOG_LEVEL_COUNT);
+    const char* fmt = header->fmt;
 
-    for (log_appender_t i = 0; i < LOG_MAX_APPENDERS; i++)
+    while (*fmt)
     {
-        log_appender_data_t* appender = &log_appenders[i];
-
-        if (!log_appender_enabled(i))
+        if ('%' != *fmt)
+        {
+            fmt++;
             continue;
+        }
+
+        log_spec_t spec;
+        fmt = log_parse_spec(fmt, &spec);
+
+        bool fits = true;
 
-        if (log_appenders[i].log_level <= level)
+        if (spec.star_width)
         {
-            char entry_str[LOG_ENTRY_LEN + 1]; // Ensure there is space for
-                                              // null char
+            int width = va_arg(args, int);
+            fits = fits && log_deferred_put(data, size, &offset, &width, sizeof(width));
+        }
+
+        if (spec.star_precision)
+        {
+            int precision = va_arg(args, int);
+            fits = fits && log_deferred_put(data, size, &offset, &precision, sizeof(precision));
+            spec.precision = precision;
+        }
+
+        switch (spec.conv)
+        {
+            case 'd': case 'i':
+            {
+                intmax_t value;
+
+                switch (spec.length)
+                {
+                    case LOG_LENGTH_HH: value = (signed char)va_arg(args, int); break;
+                    case LOG_LENGTH_H:  value = (short)va_arg(args, int);       break;
+                    case LOG_LENGTH_L:  value = va_arg(args, long);             break;
+                    case LOG_LENGTH_LL: value = va_arg(args, long long);        break;
+                    case LOG_LENGTH_J:  value = va_arg(args, intmax_t);         break;
+                    case LOG_LENGTH_Z:  value = (intmax_t)va_arg(args, size_t); break;
+                    case LOG_LENGTH_T:  value = va_arg(args, ptrdiff_t);        break;
+                    default:            value = va_arg(args, int);              break;
+                }
+
+                fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                break;
+            }
 
-            entry_str[0] = '\0'; // Ensure the entry is null terminated
+            case 'o': case 'u': case 'x': case 'X':
+            {
+                uintmax_t value;
+
+                switch (spec.length)
+                {
+                    case LOG_LENGTH_HH: value = (unsigned char)va_arg(args, unsigned);  break;
+                    case LOG_LENGTH_H:  value = (unsigned short)va_arg(args, unsigned); break;
+                    case LOG_LENGTH_L:  value = va_arg(args, unsigned long);            break;
+                    case LOG_LENGTH_LL: value = va_arg(args, unsigned long long);       break;
+                    case LOG_LENGTH_J:  value = va_arg(args, uintmax_t);                break;
+                    case LOG_LENGTH_Z:  value = va_arg(args, size_t);                   break;
+                    case LOG_LENGTH_T:  value = (uintmax_t)va_arg(args, ptrdiff_t);     break;
+                    default:            value = va_arg(args, unsigned);                 break;
+                }
+
+                fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                break;
+            }
 
-            // Append a timestamp
-            if (appender->timestamp)
+            case 'c':
             {
-                log_append_timestamp(entry_str, appender->time_fmt);
+                int value = va_arg(args, int);
+                fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                break;
             }
 
-            // Append the logger level
-            if (appender->level)
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
             {
-                log_append_level(entry_str, level, appender->colors);
+                if (LOG_LENGTH_LD == spec.length)
+                {
+                    long double value = va_arg(args, long double);
+                    fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                }
+                else
+                {
+                    double value = va_arg(args, double);
+                    fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                }
+                break;
             }
 
-            // Append the filename/line number
-            if (appender->file)
+            case 's':
             {
-                log_append_file(entry_str, file, line);
+                const char* str = va_arg(args, const char*);
+
+                if (NULL == str)
+                    str = "(null)";
+
+                // Longer strings would be truncated by the message anyway. The
+                // precision may also limit the length of a string that is not
+                // null terminated.
+                size_t max_len = LOG_MSG_LEN - 1;
+
+                if (spec.precision >= 0 && (size_t)spec.precision < max_len)
+                    max_len = (size_t)spec.precision;
+
+                const char* str_end = (const char*)memchr(str, '\0', max_len);
+                size_t len = (NULL != str_end) ? (size_t)(str_end - str) : max_len;
+
+                fits = fits && log_deferred_put(data, size, &offset, &len, sizeof(len));
+
+                if (fits && offset + LOG_DEFERRED_PAD(len + 1) <= size)
+                {
+                    memcpy(data + offset, str, len);
+                    data[offset + len] = '\0';
+                    offset += LOG_DEFERRED_PAD(len + 1);
+                }
+                else
+                {
+                    fits = false;
+                }
+                break;
             }
 
-            // Append the function name
-            if (appender->func)
+            case 'p':
             {
-                log_append_func(entry_str, func, appender->colors);
+                void* value = va_arg(args, void*);
+                fits = fits && log_deferred_put(data, size, &offset, &value, sizeof(value));
+                break;
             }
 
-            // Append the log message
-            char msg_str[LOG_MSG_LEN];
+            case 'n':
+                (void)va_arg(args, void*);
+                break;
 
-            va_list args;
-            va_start(args, fmt);
-            vsnprintf(msg_str, sizeof(msg_str), fmt, args);
-            va_end(args);
+            default:
+                break;
+        }
 
-            strncat(entry_str, msg_str, LOG_MSG_LEN);
-            strcat(entry_str, "\n");
+        if (!fits)
+            return 0;
+    }
 
-            // Locks the appender
-            if (NULL != appender->lock_fp)
+    header->size = offset;
+    memcpy(data, header, sizeof(log_deferred_header_t));
+
+    return offset;
+}
+
+/*
+ * Formats the message of a deferred record. Returns false if the record is
+ * malformed.
+ */
+static bool
+log_deferred_format (const char* fmt, const unsigned char* data, size_t size,
+                     size_t offset, char* msg, size_t msg_size)
+{
+    size_t len = 0;
+
+    msg[0] = '\0';
+
+    while (*fmt && len < msg_size - 1)
+    {
+        // Copy literal text
+        if ('%' != *fmt)
+        {
+            msg[len++] = *fmt++;
+            continue;
+        }
+
+        log_spec_t spec;
+        fmt = log_parse_spec(fmt, &spec);
+
+        int width = 0, precision = 0;
+
+        if (spec.star_width &&
+            !log_deferred_get(data, size, &offset, &width, sizeof(width)))
+            return false;
+
+        if (spec.star_precision &&
+            !log_deferred_get(data, size, &offset, &precision, sizeof(precision)))
+            return false;
+
+        // Rebuild the specification, replacing integer length modifiers
+        char spec_str[LOG_DEFERRED_SPEC_LEN];
+        size_t prefix_len = spec.prefix_len;
+
+        if (prefix_len > LOG_DEFERRED_SPEC_LEN - 4)
+            return false;
+
+        memcpy(spec_str, spec.start, prefix_len);
+
+        char* end = spec_str + prefix_len;
+
+        char*  dst = msg + len;
+        size_t dst_size = msg_size - len;
+        int    ret = 0;
+
+        #define LOG_DEFERRED_PRINT(value) \
+            (spec.star_width && spec.star_precision \
+                ? snprintf(dst, dst_size, spec_str, width, precision, value) \
+                : spec.star_width \
+                ? snprintf(dst, dst_size, spec_str, width, value) \
+                : spec.star_precision \
+                ? snprintf(dst, dst_size, spec_str, precision, value) \
+                : snprintf(dst, dst_size, spec_str, value))
+
+        switch (spec.conv)
+        {
+            case '%':
+                ret = snprintf(dst, dst_size, "%%");
+                break;
+
+            case 'd': case 'i':
             {
-                appender->lock_fp(true, appender->lock_udata);
+                intmax_t value;
+
+                if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                    return false;
+
+                end[0] = 'j'; end[1] = spec.conv; end[2] = '\0';
+                ret = LOG_DEFERRED_PRINT(value);
+                break;
             }
 
-            appender->appender_fp(entry_str, appender->udata);
+            case 'o': case 'u': case 'x': case 'X':
+            {
+                uintmax_t value;
 
-            // Unlocks the appender
-            if (NULL != appender->lock_fp)
+                if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                    return false;
+
+                end[0] = 'j'; end[1] = spec.conv; end[2] = '\0';
+                ret = LOG_DEFERRED_PRINT(value);
+                break;
+            }
+
+            case 'c':
             {
-                appender->lock_fp(false, appender->lock_udata);
+                int value;
+
+                if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                    return false;
+
+                end[0] = spec.conv; end[1] = '\0';
+                ret = LOG_DEFERRED_PRINT(value);
+                break;
+            }
+
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+            {
+                if (LOG_LENGTH_LD == spec.length)
+                {
+                    long double value;
+
+                    if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                        return false;
+
+                    end[0] = 'L'; end[1] = spec.conv; end[2] = '\0';
+                    ret = LOG_DEFERRED_PRINT(value);
+                }
+                else
+                {
+                    double value;
+
+                    if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                        return false;
+
+                    end[0] = spec.conv; end[1] = '\0';
+                    ret = LOG_DEFERRED_PRINT(value);
+                }
+                break;
+            }
+
+            case 's':
+            {
+                size_t str_len;
+
+                if (!log_deferred_get(data, size, &offset, &str_len, sizeof(str_len)))
+                    return false;
+
+                if (offset + LOG_DEFERRED_PAD(str_len + 1) > size ||
+                    '\0' != data[offset + str_len])
+                    return false;
+
+                const char* value = (const char*)data + offset;
+                offset += LOG_DEFERRED_PAD(str_len + 1);
+
+                end[0] = 's'; end[1] = '\0';
+                ret = LOG_DEFERRED_PRINT(value);
+                break;
+            }
+
+            case 'p':
+            {
+                void* value;
+
+                if (!log_deferred_get(data, size, &offset, &value, sizeof(value)))
+                    return false;
+
+                end[0] = 'p'; end[1] = '\0';
+                ret = LOG_DEFERRED_PRINT(value);
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        #undef LOG_DEFERRED_PRINT
+
+        len += log_clamp_len(ret, dst_size);
+    }
+
+    msg[len] = '\0';
+
+    return true;
+}
+
+size_t
+log_set_deferred_buffer (void* buffer, size_t size)
+{
+    // Ensure the buffer and size agree
+    LOG_ASSERT((NULL == buffer) == (0 == size));
+
+    size_t used = log_deferred_buffer.used;
+
+    log_deferred_buffer.data = (unsigned char*)buffer;
+    log_deferred_buffer.size = size;
+    log_deferred_buffer.used = 0;
+
+    return used;
+}
+
+size_t
+log_flush_deferred (void)
+{
+    size_t count = log_decode_deferred(log_deferred_buffer.data,
+                                       log_deferred_buffer.used);
+
+    log_deferred_buffer.used = 0;
+
+    return count;
+}
+
+size_t
+log_decode_deferred (const void* data, size_t size)
+{
+    const unsigned char* ptr = (const unsigned char*)data;
+    size_t count = 0;
+
+    while (size >= sizeof(log_deferred_header_t))
+    {
+        log_deferred_header_t header;
+        memcpy(&header, ptr, sizeof(header));
+
+        // Stop at a malformed record
+        if (header.size < sizeof(header) || header.size > size ||
+            header.level >= LOG_LEVEL_COUNT)
+            break;
+
+        log_queue_cell_t* cell = NULL;
+        log_record_t local_record;
+        unsigned pos = 0;
+
+        log_record_t* record = log_begin_record(&local_record, &cell, &pos);
+
+        if (NULL != record)
+        {
+            record->level = (log_level_t)header.level;
+            record->file  = header.file;
+            record->line  = header.line;
+            record->func  = header.func;
+            record->time  = header.time;
+            record->nsec  = header.nsec;
+
+            // Restore the context
+            size_t offset = LOG_DEFERRED_PAD(sizeof(log_deferred_header_t));
+            bool valid = header.context_count <= LOG_MAX_CONTEXT;
+
+            record->context.thread = header.thread;
+            record->context.count  = valid ? header.context_count : 0;
+
+            for (unsigned i = 0; valid && i < header.context_count; i++)
+            {
+                valid = log_deferred_get(ptr, header.size, &offset,
+                                         &record->context.keys[i],
+                                         sizeof(record->context.keys[i])) &&
+                        log_deferred_get(ptr, header.size, &offset,
+                                         &record->context.values[i],
+                                         sizeof(record->context.values[i]));
+            }
+
+            if (!valid || !log_deferred_format(header.fmt, ptr, header.size, offset,
+                                               record->msg, sizeof(record->msg)))
+            {
+                record->context.count = 0;
+
+                // Still publish the record in order to release the cell
+                strcpy(record->msg, "(malformed deferred record)");
             }
+
+            log_end_record(record, cell, pos);
+            count++;
+        }
+
+        ptr  += header.size;
+        size -= header.size;
+    }
+
+    return count;
+}
+
+/*
+ * Records an entry in the deferred buffer of the calling thread.
+ */
+static void
+log_vwrite_deferred (log_level_t level, const char* file, unsigned line,
+                                        const char* func, time_t time, long nsec,
+                                        const char* fmt, va_list args)
+{
+    log_deferred_buffer_t* buffer = &log_deferred_buffer;
+
+    log_deferred_header_t header;
+
+    header.fmt   = fmt;
+    header.file  = file;
+    header.func  = func;
+    header.time  = time;
+    header.nsec  = nsec;
+    header.line  = line;
+    header.level = (unsigned)level;
+    header.size  = 0;
+
+    header.thread        = log_thread_id();
+    header.context_count = log_context.count;
+
+    va_list copy;
+
+    if (NULL != buffer->data)
+    {
+        va_copy(copy, args);
+        size_t size = log_deferred_encode(buffer->data + buffer->used,
+                                          buffer->size - buffer->used,
+                                          &header, copy);
+        va_end(copy);
+
+        // Flush the buffer and try again
+        if (0 == size && buffer->used > 0)
+        {
+            log_flush_deferred();
+
+            va_copy(copy, args);
+            size = log_deferred_encode(buffer->data, buffer->size, &header, copy);
+            va_end(copy);
+        }
+
+        if (size > 0)
+        {
+            buffer->used += size;
+            return;
         }
     }
+
+    // No buffer or the record is larger than the buffer
+    log_vwrite(level, file, line, func, time, nsec, fmt, args);
+}
+
+static void
+log_write_suppressed (bool deferred, log_level_t level, const char* file,
+                                     unsigned line, const char* func,
+                                     time_t time, long nsec,
+                                     const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    if (deferred)
+    {
+        log_vwrite_deferred(level, file, line, func, time, nsec, fmt, args);
+    }
+    else
+    {
+        log_vwrite(level, file, line, func, time, nsec, fmt, args);
+    }
+
+    va_end(args);
+}
+
+void
+log_write_deferred (log_level_t level, const char* file, unsigned line,
+                                       const char* func, const char* fmt, ...)
+{
+    // Ensure logger is initialized
+    log_try_init();
+
+    // Only record entry if an enabled appender accepts the level
+    if (level < PICO_LOG_ACTIVE_LEVEL())
+    {
+        return;
+    }
+
+    // Ensure valid log level
+    LOG_ASSERT(level < LOG_LEVEL_COUNT);
+
+    long long now = log_now();
+    unsigned suppressed;
+
+    // Drop the entry if the call site exceeded its rate limit
+    if (!log_rate_check(file, line, now, &suppressed))
+    {
+        return;
+    }
+
+    time_t time;
+    long nsec;
+
+    log_split_time(now, &time, &nsec);
+
+    if (suppressed > 0)
+    {
+        log_write_suppressed(true, level, file, line, func, time, nsec,
+                             LOG_SUPPRESSED_FMT, suppressed);
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    log_vwrite_deferred(level, file, line, func, time, nsec, fmt, args);
+    va_end(args);
 }
 
 #endif // PICO_LOG_IMPLEMENTATION
@@ -5,6 +5,7 @@
 #include "../pico_unit.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 static bool encode_test(const char* src, const char* expected)
 {
@@ -72,11 +73,308 @@ TEST_CASE(test_decode)
     return true;
 }
 
+// Decoding stops at the first character outside of the alphabet
+TEST_CASE(test_decode_invalid)
+{
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                           "abcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char buf[3];
+    int c;
+
+    for (c = 0; c < 256; c++)
+    {
+        char src[] = { 'Z', 'm', '9', (char)c };
+        size_t expected = (c && strchr(alphabet, c)) ? 3 : 2;
+
+        REQUIRE(expected == b64_decode(buf, src, 4));
+        REQUIRE(0 == memcmp(buf, "fo", 2));
+    }
+
+    return true;
+}
+
+// Encodes/decodes in chunks of every size and compares with the one-shot API
+TEST_CASE(test_stream)
+{
+    static unsigned char src[200];
+    static char enc[2][280];
+    static unsigned char dec[200];
+
+    static const int flags[] = { B64_STANDARD, B64_URL | B64_NO_PAD, B64_MIME };
+
+    size_t i, f, chunk, size, total;
+
+    for (i = 0; i < sizeof(src); i++)
+        src[i] = (unsigned char)(i * 37 + 11);
+
+    for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    for (chunk = 1; chunk <= 70; chunk++)
+    {
+        size_t len = sizeof(src) - chunk % 3;
+        b64_encoder_t encoder;
+        b64_decoder_t decoder;
+
+        size = b64_encode_ex(enc[0], src, len, flags[f]);
+
+        REQUIRE(size == b64_encoded_size_ex(len, flags[f]));
+
+        b64_encoder_init(&encoder, flags[f]);
+
+        for (i = 0, total = 0; i < len; i += chunk)
+        {
+            size_t n = (len - i < chunk) ? len - i : chunk;
+            total += b64_encoder_update(&encoder, enc[1] + total, src + i, n);
+        }
+
+        total += b64_encoder_finish(&encoder, enc[1] + total);
+
+        REQUIRE(size == total);
+        REQUIRE(0 == memcmp(enc[0], enc[1], size));
+
+        b64_decoder_init(&decoder, flags[f]);
+
+        for (i = 0, total = 0; i < size; i += chunk)
+        {
+            size_t n = (size - i < chunk) ? size - i : chunk;
+            total += b64_decoder_update(&decoder, dec + total, enc[1] + i, n);
+        }
+
+        total += b64_decoder_finish(&decoder, dec + total);
+
+        REQUIRE(len == total);
+        REQUIRE(0 == memcmp(src, dec, len));
+    }
+
+    return true;
+}
+
+TEST_CASE(test_sizes)
+{
+    REQUIRE(0 == b64_encoded_size(0));
+    REQUIRE(4 == b64_encoded_size(1));
+    REQUIRE(4 == b64_encoded_size(3));
+    REQUIRE(8 == b64_encoded_size(4));
+
+    REQUIRE(0 == b64_decoded_size("", 0));
+    REQUIRE(0 == b64_decoded_size("Zg=", 3));
+    REQUIRE(1 == b64_decoded_size("Zg==", 4));
+    REQUIRE(2 == b64_decoded_size("Zm8=", 4));
+    REQUIRE(3 == b64_decoded_size("Zm9v", 4));
+    REQUIRE(4 == b64_decoded_size("Zm9vYg==", 8));
+
+    return true;
+}
+
+static bool encode_ex_test(const char* src, int flags, const char* expected)
+{
+    char buf[256];
+    size_t size = b64_encode_ex(buf, (const unsigned char*)src, strlen(src), flags);
+    return size == b64_encoded_size_ex(strlen(src), flags) &&
+           size == strlen(expected) && 0 == memcmp(buf, expected, size);
+}
+
+static bool decode_ex_test(const char* src, int flags, const char* expected,
+                           size_t expected_error)
+{
+    unsigned char buf[256];
+    size_t error;
+    size_t size = b64_decode_ex(buf, src, strlen(src), flags, &error);
+    return error == expected_error &&
+           size == strlen(expected) && 0 == memcmp(buf, expected, size);
+}
+
+TEST_CASE(test_variants)
+{
+    // URL-safe alphabet
+    REQUIRE(encode_ex_test("\xfb\xff", B64_STANDARD, "+/8="));
+    REQUIRE(encode_ex_test("\xfb\xff", B64_URL, "-_8="));
+    REQUIRE(encode_ex_test("\xfb\xff", B64_URL | B64_NO_PAD, "-_8"));
+    REQUIRE(decode_ex_test("-_8", B64_URL, "\xfb\xff", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("-_8=", B64_URL, "\xfb\xff", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("+/8=", B64_URL | B64_STRICT, "", 0));
+    REQUIRE(decode_ex_test("-_8=", B64_STRICT, "", 0));
+
+    // No padding
+    REQUIRE(encode_ex_test("f", B64_NO_PAD, "Zg"));
+    REQUIRE(encode_ex_test("fo", B64_NO_PAD, "Zm8"));
+    REQUIRE(encode_ex_test("foo", B64_NO_PAD, "Zm9v"));
+    REQUIRE(decode_ex_test("Zm8", B64_NO_PAD | B64_STRICT, "fo", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("Zm8=", B64_NO_PAD | B64_STRICT, "fo", 3));
+
+    // MIME line wrapping
+    REQUIRE(encode_ex_test("Many hands make light work. Many hands make light work.",
+                           B64_MIME,
+                           "TWFueSBoYW5kcyBtYWtlIGxpZ2h0IHdvcmsuIE1hbnkgaGFuZHMgbWFr"
+                           "ZSBsaWdodCB3b3JrLg=="));
+
+    REQUIRE(encode_ex_test("Many hands make light work. Many hands make light work!!!",
+                           B64_MIME,
+                           "TWFueSBoYW5kcyBtYWtlIGxpZ2h0IHdvcmsuIE1hbnkgaGFuZHMgbWFr"
+                           "ZSBsaWdodCB3b3JrISEh"));
+
+    REQUIRE(encode_ex_test("Many hands make light work. Many hands make light work!!!!",
+                           B64_MIME,
+                           "TWFueSBoYW5kcyBtYWtlIGxpZ2h0IHdvcmsuIE1hbnkgaGFuZHMgbWFr"
+                           "ZSBsaWdodCB3b3JrISEh\r\nIQ=="));
+
+    REQUIRE(decode_ex_test("Zm9v\r\nYm Fy\n", B64_MIME | B64_STRICT, "foobar", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("Zm8=\r\n", B64_MIME | B64_STRICT, "fo", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("Zm9v\r\nYmFy", B64_STRICT, "foo", 4));
+
+    // Strict mode
+    REQUIRE(decode_ex_test("Zm9vYmFy", B64_STRICT, "foobar", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("Zm9v!mFy", B64_STRICT, "foo", 4));
+    REQUIRE(decode_ex_test("Zm9vY!Fy", B64_STRICT, "foo", 5));
+    REQUIRE(decode_ex_test("Zg==Zg==", B64_STRICT, "f", 4));
+    REQUIRE(decode_ex_test("Zg===", B64_STRICT, "f", 4));
+    REQUIRE(decode_ex_test("Z===", B64_STRICT, "", 1));
+    REQUIRE(decode_ex_test("Zg=", B64_STRICT, "f", 3));
+    REQUIRE(decode_ex_test("Zg", B64_STRICT, "f", 2));
+    REQUIRE(decode_ex_test("Zm9vY", B64_STRICT, "foo", 5));
+
+    // Without strict mode decoding silently stops
+    REQUIRE(decode_ex_test("Zm9v!mFy", B64_STANDARD, "foo", B64_NO_ERROR));
+    REQUIRE(decode_ex_test("Zg==Zg==", B64_STANDARD, "f", B64_NO_ERROR));
+
+    return true;
+}
+
+// Compares every available instruction set against the scalar code
+TEST_CASE(test_simd)
+{
+    static unsigned char src[1024];
+    static char enc[2][1404];
+    static unsigned char dec[1024];
+
+    static const int flags[] = { B64_STANDARD, B64_URL, B64_MIME };
+
+    b64_simd_t best = b64_get_simd();
+    size_t len, i, f;
+    int simd;
+
+    srand(1);
+
+    for (i = 0; i < sizeof(src); i++)
+        src[i] = rand() & 0xff;
+
+    for (simd = B64_SIMD_SSSE3; simd <= (int)best; simd++)
+    {
+        for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        for (len = 0; len <= sizeof(src); len += (len < 130) ? 1 : 97)
+        {
+            b64_set_simd(B64_SIMD_NONE);
+            size_t size = b64_encode_ex(enc[0], src, len, flags[f]);
+
+            b64_set_simd((b64_simd_t)simd);
+            REQUIRE(size == b64_encode_ex(enc[1], src, len, flags[f]));
+            REQUIRE(0 == memcmp(enc[0], enc[1], size));
+
+            REQUIRE(len == b64_decode_ex(dec, enc[1], size, flags[f], NULL));
+            REQUIRE(0 == memcmp(src, dec, len));
+        }
+
+        // Invalid characters must stop decoding at the same place
+        for (i = 0; i < 200; i++)
+        {
+            size_t size = b64_encode(enc[0], src, 150);
+            char bad[] = { '=', '-', '_', ' ', '\n', '\0', '@', '[', '`', '{', (char)0x80 };
+
+            enc[0][i] = bad[i % sizeof(bad)];
+
+            b64_set_simd(B64_SIMD_NONE);
+            size_t expected = b64_decode(dec, enc[0], size);
+
+            b64_set_simd((b64_simd_t)simd);
+            REQUIRE(expected == b64_decode(dec, enc[0], size));
+            REQUIRE(expected == i / 4 * 3 + (i % 4 > 1 ? i % 4 - 1 : 0));
+        }
+    }
+
+    // Only kernels built for this architecture and supported by the CPU
+    for (simd = B64_SIMD_NONE; simd <= B64_SIMD_NEON; simd++)
+    {
+        b64_set_simd((b64_simd_t)simd);
+
+        b64_simd_t used = b64_get_simd();
+
+        if ((B64_SIMD_NEON == simd) != (B64_SIMD_NEON == best))
+            REQUIRE(B64_SIMD_NONE == used);
+        else
+            REQUIRE(used <= (b64_simd_t)simd && used <= best);
+    }
+
+    b64_set_simd(best);
+
+    return true;
+}
+
+// Compares the parallel functions with the serial ones
+TEST_CASE(test_parallel)
+{
+    static const int flags[] = { B64_STANDARD, B64_URL | B64_NO_PAD, B64_MIME };
+    static const int threads[] = { 1, 3, 8, 1000 };
+
+    static unsigned char src[1000001];
+    static char enc[2][1400000];
+    static unsigned char dec[2][1000001];
+
+    size_t i, f, t;
+
+    for (i = 0; i < sizeof(src); i++)
+        src[i] = (unsigned char)(i * 2654435761u >> 13);
+
+    for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        size_t size = b64_encode_ex(enc[0], src, sizeof(src), flags[f]);
+
+        REQUIRE(size == b64_encode_parallel(enc[1], src, sizeof(src),
+                                            flags[f], threads[t]));
+
+        REQUIRE(0 == memcmp(enc[0], enc[1], size));
+
+        REQUIRE(sizeof(src) == b64_decode_parallel(dec[1], enc[1], size,
+                                                   flags[f], NULL, threads[t]));
+
+        REQUIRE(0 == memcmp(src, dec[1], sizeof(src)));
+    }
+
+    // Invalid characters and padding must stop decoding at the same place
+    size_t size = b64_encode(enc[0], src, sizeof(src));
+
+    for (i = 0; i < 12; i++)
+    {
+        size_t pos = (i + 1) * (size / 13) + i % 4;
+        size_t error[2], expected;
+        char c = enc[0][pos];
+
+        enc[0][pos] = (i % 2) ? '=' : '!';
+
+        expected = b64_decode_ex(dec[0], enc[0], size, B64_STRICT, &error[0]);
+
+        REQUIRE(expected == b64_decode_parallel(dec[1], enc[0], size,
+                                                B64_STRICT, &error[1], 8));
+
+        REQUIRE(error[0] == error[1]);
+        REQUIRE(0 == memcmp(dec[0], dec[1], expected));
+
+        enc[0][pos] = c;
+    }
+
+    return true;
+}
+
 int main()
 {
     pu_display_colors(true);
     RUN_TEST_CASE(test_encode);
     RUN_TEST_CASE(test_decode);
+    RUN_TEST_CASE(test_decode_invalid);
+    RUN_TEST_CASE(test_simd);
+    RUN_TEST_CASE(test_stream);
+    RUN_TEST_CASE(test_sizes);
+    RUN_TEST_CASE(test_variants);
+    RUN_TEST_CASE(test_parallel);
     pu_print_stats();
     return pu_test_failed();
 }